@@ -19,6 +19,7 @@ auto Parser::advance() -> void
     bool is_command = false;
     while (hasMoreCommands() && !is_command) {
         getline(m_file, line);
+        m_line_number++;
 
         // Remove comment section from command
         if (line.find("//") != std::string::npos) {
@@ -28,14 +28,19 @@ public:
 
     auto startsWithDigit(std::string symbol) -> bool { return isdigit(symbol[0]); }
 
+    // Line of the current command, starting at 1
+    auto lineNumber() -> int { return m_line_number; }
+
     auto reset() -> void
     {
         m_file.clear();
         m_file.seekg(0);
+        m_line_number = 0;
     }
 
 private:
     CommandType m_command_type;
     std::string m_command;
     std::ifstream m_file;
+    int m_line_number = 0;
 };
\ No newline at end of file
@@ -0,0 +1,59 @@
+#include "SourceMap.h"
+#include <fstream>
+#include <stdexcept>
+
+auto write_varint(std::string& out, uint64_t value) -> void
+{
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+auto zigzag(int64_t value) -> uint64_t
+{
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+auto SourceMap::add(const std::string& file, const int line) -> void
+{
+    int index = 0;
+    while (index < static_cast<int>(m_files.size()) && m_files[index] != file)
+        index++;
+    if (index == static_cast<int>(m_files.size()))
+        m_files.push_back(file);
+    m_locations.push_back({index, line});
+}
+
+auto SourceMap::write(const std::string& path) -> void
+{
+    std::string out = "HSM1";
+    write_varint(out, m_files.size());
+    for (auto& file : m_files) {
+        write_varint(out, file.size());
+        out += file;
+    }
+
+    // Runs of equal locations: length and location
+    std::vector<std::pair<uint64_t, std::pair<int, int>>> runs;
+    for (auto& location : m_locations) {
+        if (!runs.empty() && runs.back().second == location)
+            runs.back().first++;
+        else
+            runs.push_back({1, location});
+    }
+    write_varint(out, runs.size());
+    std::pair<int, int> previous{0, 0};
+    for (auto& [length, location] : runs) {
+        write_varint(out, length);
+        write_varint(out, zigzag(location.first - previous.first));
+        write_varint(out, zigzag(location.second - previous.second));
+        previous = location;
+    }
+
+    std::ofstream fout(path, std::ios::binary);
+    if (!fout.is_open())
+        throw std::runtime_error("Could not open " + path);
+    fout << out;
+}
@@ -0,0 +1,25 @@
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+Source line of every ROM word, written next to the .hack file (Prog.hack.map).
+Same binary format as the rest of the toolchain:
+
+    "HSM1"
+    varint n_files, per file: varint length, name
+    varint n_runs, per run: varint length, zigzag varint file delta, zigzag varint line delta
+
+A run covers consecutive words with the same location, deltas are taken to the previous run.
+*/
+class SourceMap
+{
+public:
+    auto add(const std::string& file, const int line) -> void;
+
+    auto write(const std::string& path) -> void;
+
+private:
+    std::vector<std::string> m_files;
+    std::vector<std::pair<int, int>> m_locations;  // file index, line
+};
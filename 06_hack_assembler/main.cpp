@@ -3,6 +3,7 @@
 #include <iostream>
 #include "CodeTranslator.h"
 #include "Parser.h"
+#include "SourceMap.h"
 #include "SymbolTable.h"
 
 /*
@@ -22,8 +23,9 @@ auto getOutputFileName(std::string& input_file) -> std::string
 
 int main(int argc, char* argv[])
 {
-    if (argc == 1 || argc > 2) {
-        throw std::invalid_argument("Usage: 'assemble <input_file_name>.asm'");
+    bool write_map = argc == 3 && std::string(argv[2]) == "--map";
+    if (argc == 1 || (argc > 2 && !write_map)) {
+        throw std::invalid_argument("Usage: 'assemble <input_file_name>.asm [--map]'");
         return 0;
     }
 
@@ -34,6 +36,8 @@ int main(int argc, char* argv[])
     auto stable           = SymbolTable();
     auto output_file_name = getOutputFileName(input_file_name);
     auto fout             = std::ofstream();
+    auto source_map       = SourceMap();
+    auto source_name      = input_file_name.substr(input_file_name.rfind("/") + 1);
 
     // Create the output file
     fout.open(output_file_name);
@@ -63,6 +67,8 @@ int main(int argc, char* argv[])
         }
 
         auto command_type = parser.commandType();
+        if (write_map && (command_type == A || command_type == C))
+            source_map.add(source_name, parser.lineNumber());
 
         if (command_type == A) {
             auto symbol        = parser.symbol();
@@ -99,5 +105,7 @@ int main(int argc, char* argv[])
         }
     }
     fout.close();
+    if (write_map)
+        source_map.write(output_file_name + ".map");
     return 0;
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #pragma once
+#include "InlineCache.h"
 #include "JackTokenizer.h"
 #include "SymbolTable.h"
 #include "VMWriter.h"
@@ -17,6 +18,12 @@ private:
     std::string mPrevType;
     std::string mClassName;
     int mLabelCounter;
+    std::shared_ptr<InlineCache> mInlineCache;
+    FunctionType mFunctionType; // Of the subroutine being compiled
+
+    // The commands replacing a call of body with nArgs arguments.
+    auto inlineCommands(InlineBody const &body, int nArgs)
+        -> std::vector<std::vector<std::string>>;
 
 public:
     CompilationEngine(std::unique_ptr<SymbolTable> symbolTable,
@@ -24,7 +31,8 @@ public:
                       std::unique_ptr<VMWriter> vmWriter, std::string outputFileName)
         : mSymbolTable(std::move(symbolTable)), mTokenizer(std::move(jackTokenizer)),
           mVMWriter(std::move(vmWriter)), mOutputFile(outputFileName),
-          mDepth(0), mPrevType{""}, mClassName{""}, mLabelCounter(0){};
+          mDepth(0), mPrevType{""}, mClassName{""}, mLabelCounter(0), mInlineCache(),
+          mFunctionType(FunctionType::FUNCTION){};
 
     ~CompilationEngine()
     {
@@ -32,6 +40,16 @@ public:
         mOutputFile.close();
     };
 
+    // Inline calls to the small leaf subroutines found in inlineCache.
+    auto setInlineCache(std::shared_ptr<InlineCache> inlineCache) -> void
+    {
+        mInlineCache = std::move(inlineCache);
+    };
+
+    // Write a call, or the body of the callee if it can be inlined without
+    // taking more commands than the call.
+    auto writeCall(std::string const &name, int nArgs) -> void;
+
     auto tokenTypeToString(TokenType token) -> std::string;
 
     auto handleIdentifier(std::string name) -> void;
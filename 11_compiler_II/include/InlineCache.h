@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Most VM commands a call is replaced with, about the code of a call in the
+// translator's default lowering, so that inlining does not grow the program.
+inline constexpr int INLINE_CALL_SIZE = 4;
+
+// Inlined arguments and locals live in temp INLINE_TEMP_BASE and up, the
+// caller's this pointer is kept in the last temp while a method body runs.
+inline constexpr int INLINE_TEMP_BASE = 2;
+inline constexpr int INLINE_THIS_TEMP = 7;
+
+struct InlineBody
+{
+    std::string className;
+    int nLocals;
+    int nArgsUsed; // One past the highest argument index in the body
+    std::vector<std::vector<std::string>> commands; // Tokenized VM commands
+    bool usesStatic;
+    bool setsThis; // Body writes pointer 0, e.g. the prologue of a method
+    bool usesThat; // Body uses that or pointer 1
+    // Body starts with the method prologue push argument 0; pop pointer 0 and
+    // uses neither argument 0 nor pointer 0 after it.
+    bool thisFromArgument;
+};
+
+// Bodies of small leaf subroutines, read from already compiled .vm files.
+//
+// A body qualifies when it has no calls, labels or jumps, ends in its only
+// return and does not use the temp segment itself.
+class InlineCache
+{
+private:
+    std::unordered_map<std::string, InlineBody> mBodies;
+
+    auto addBody(std::string const &name, InlineBody body, int nReturns) -> void;
+
+public:
+    InlineCache(){};
+
+    auto load(std::string const &vmPath) -> void;
+
+    // Body of name if it can replace a call with nArgs arguments from callerClass.
+    auto find(std::string const &name, int nArgs, std::string const &callerClass)
+        -> InlineBody const *;
+
+    auto size() -> size_t
+    {
+        return mBodies.size();
+    };
+};
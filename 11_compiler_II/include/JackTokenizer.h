@@ -17,11 +17,12 @@ private:
     TokenType m_token_type;
     TokenType m_prev_token_type;
     Kind m_last_kind;
+    int m_line_number;
 
 public:
     JackTokenizer(std::string input_path)
         : m_file(input_path), m_token(""), m_line(""), m_prev_token(""),
-          m_line_it(m_line.end()), m_last_kind(Kind::NONE){};
+          m_line_it(m_line.end()), m_last_kind(Kind::NONE), m_line_number(0){};
 
     ~JackTokenizer()
     {
@@ -62,6 +63,12 @@ public:
         return m_token;
     };
 
+    // Line of the current token, 1-based.
+    auto lineNumber() -> int
+    {
+        return m_line_number;
+    };
+
     auto prevToken() -> std::string
     {
         while (m_prev_token.find("\"") != std::string::npos)
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct SourceLocation
+{
+    int file; // Index into the files of the map
+    int line; // 1-based, 0 if unknown
+};
+
+// Jack source line of every written VM command, stored as a sidecar file
+// next to the code (Main.vm.map). The format is shared with the toolchain:
+//
+//     "HSM1"
+//     varint nFiles, per file: varint length, name
+//     varint nRuns, per run: varint length, zigzag varint file delta,
+//                            zigzag varint line delta
+//
+// A run covers consecutive commands with the same location, deltas are taken
+// to the previous run. All varints are LEB128.
+class SourceMap
+{
+private:
+    std::vector<std::string> mFiles;
+    std::vector<SourceLocation> mLocations;
+
+public:
+    SourceMap() : mFiles(), mLocations(){};
+
+    // Location of the next command.
+    auto add(std::string const &file, int line) -> void;
+
+    auto empty() -> bool
+    {
+        return mLocations.empty();
+    };
+
+    auto write(std::string const &path) -> void;
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// Binary form of the written VM commands, stored next to the text (Main.vmb)
+// and loaded by the toolchain without tokenizing. The format is shared with
+// the toolchain, all numbers are little endian 32 bit words unless noted:
+//
+//     "VMB1", nCommands, nFunctions, nStringBytes
+//     nFunctions times: name, index of the function command, nLocals
+//     nCommands times, 8 bytes each:
+//         u8 type, u8 segment or arithmetic command, u16 nArgs or nLocals,
+//         u32 segment index or name
+//     nStringBytes of names, each terminated by a zero byte
+//
+// Names are byte offsets into the strings, every name is stored once.
+class VMBytecode
+{
+private:
+    std::string mFunctions;
+    std::string mCommands;
+    std::string mStrings;
+    std::map<std::string, uint32_t> mOffsets;
+    uint32_t mCommandCount;
+    uint32_t mFunctionCount;
+
+    auto name(std::string const &value) -> uint32_t;
+
+public:
+    VMBytecode()
+        : mFunctions(), mCommands(), mStrings(), mOffsets(), mCommandCount(0),
+          mFunctionCount(0){};
+
+    // Encode one VM command given as its words, e.g. {"push", "local", "0"}.
+    auto add(std::vector<std::string> const &words) -> void;
+
+    auto write(std::string const &path) -> void;
+};
@@ -1,21 +1,63 @@
 #pragma once
 
+#include "SourceMap.h"
+#include "VMBytecode.h"
 #include "definitions.h"
 #include <fstream>
 #include <string>
+#include <vector>
 
 class VMWriter
 {
 private:
     std::ofstream mOutputFile;
+    SourceMap mSourceMap;
+    std::string mSourceMapPath; // Empty if no map is written
+    std::string mSourceName;
+    int mSourceLine;
+    VMBytecode mBytecode;
+    std::string mBytecodePath; // Empty if no bytecode is written
+    bool mPeephole;
+    std::vector<std::string> mHeld; // Command held back by writeCommand, if any
+    int mHeldLine;
+
+    // Write a command to the outputs, line is its source line.
+    auto emit(std::vector<std::string> const &words, int line) -> void;
 
 public:
-    VMWriter(std::string filename) : mOutputFile(filename){};
+    VMWriter(std::string filename)
+        : mOutputFile(filename), mSourceMap(), mSourceMapPath(), mSourceName(),
+          mSourceLine(0), mBytecode(), mBytecodePath(), mPeephole(false), mHeld(),
+          mHeldLine(0){};
 
     ~VMWriter()
     {
-        if (mOutputFile.is_open())
-            mOutputFile.close();
+        this->close();
+    };
+
+    // Write the source line of every command to mapPath on close.
+    auto enableSourceMap(std::string mapPath, std::string sourceName) -> void
+    {
+        mSourceMapPath = mapPath;
+        mSourceName = sourceName;
+    };
+
+    // Also write every command as bytecode to path on close.
+    auto enableBytecode(std::string path) -> void
+    {
+        mBytecodePath = path;
+    };
+
+    // Cancel not; not and end void subroutines in the value of a do, see
+    // writeCommand and writeVoidReturn. Off, the commands are written as compiled.
+    auto enablePeephole() -> void
+    {
+        mPeephole = true;
+    };
+
+    auto setSourceLine(int line) -> void
+    {
+        mSourceLine = line;
     };
 
     auto writePush(Segment segment, int index) -> void;
@@ -37,9 +79,29 @@ public:
 
     auto writeReturn() -> void;
 
+    // return; of a void subroutine. With the peephole, right after a do the
+    // called subroutine's value is returned instead of 0, which nobody reads,
+    // so the call is followed by the return and can become a tail call.
+    auto writeVoidReturn() -> void;
+
+    // Write an already formed VM command, e.g. from an inlined body. All
+    // other write functions end up here. With the peephole, a not is held
+    // back until the next command, two in a row cancel out, such as the ~ of
+    // an if condition and the not that branches on its negation. So is the
+    // pop temp 0 of a do.
+    auto writeCommand(std::vector<std::string> const &words) -> void;
+
     auto close() -> void
     {
-        if (mOutputFile.is_open())
-            mOutputFile.close();
+        if (!mOutputFile.is_open())
+            return;
+        if (!mHeld.empty())
+            this->emit(mHeld, mHeldLine);
+        mHeld.clear();
+        mOutputFile.close();
+        if (!mSourceMapPath.empty())
+            mSourceMap.write(mSourceMapPath);
+        if (!mBytecodePath.empty())
+            mBytecode.write(mBytecodePath);
     };
 };
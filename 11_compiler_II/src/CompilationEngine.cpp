@@ -21,6 +21,84 @@ auto CompilationEngine::tokenTypeToString(TokenType token) -> std::string
     return type;
 }
 
+auto CompilationEngine::writeCall(std::string const &name, int nArgs) -> void
+{
+    InlineBody const *body = nullptr;
+    if (mInlineCache)
+        body = mInlineCache->find(name, nArgs, mClassName);
+    if (body)
+    {
+        auto commands = this->inlineCommands(*body, nArgs);
+        if (static_cast<int>(commands.size()) <= INLINE_CALL_SIZE)
+        {
+            for (auto const &words : commands)
+                mVMWriter->writeCommand(words);
+            return;
+        }
+    }
+    mVMWriter->writeCall(name, nArgs);
+}
+
+auto CompilationEngine::inlineCommands(InlineBody const &body, int nArgs)
+    -> std::vector<std::vector<std::string>>
+{
+    auto popTemp = [](int index) {
+        return std::vector<std::string>{"pop", "temp", std::to_string(index)};
+    };
+    std::vector<std::vector<std::string>> commands;
+    // Only methods and constructors use this after the call. A method body
+    // reaches its fields through that instead when it leaves that alone, which
+    // the caller sets right before each use.
+    bool callerThis = mFunctionType != FunctionType::FUNCTION;
+    bool thisAsThat = callerThis && body.thisFromArgument && !body.usesThat;
+    bool saveThis = callerThis && body.setsThis && !thisAsThat;
+    if (saveThis)
+    {
+        commands.push_back({"push", "pointer", "0"});
+        commands.push_back(popTemp(INLINE_THIS_TEMP));
+    }
+
+    // Move the arguments from the stack into temps, last one on top. Argument
+    // 0 of the method prologue goes straight into the pointer instead.
+    for (int i = nArgs - 1; i >= 0; i--)
+    {
+        if (i == 0 && body.thisFromArgument)
+            commands.push_back({"pop", "pointer", thisAsThat ? "1" : "0"});
+        else
+            commands.push_back(popTemp(INLINE_TEMP_BASE + i));
+    }
+    // Locals start zeroed like in a real frame.
+    for (int i = 0; i < body.nLocals; i++)
+    {
+        commands.push_back({"push", "constant", "0"});
+        commands.push_back(popTemp(INLINE_TEMP_BASE + nArgs + i));
+    }
+
+    for (size_t k = body.thisFromArgument ? 2 : 0; k < body.commands.size(); k++)
+    {
+        auto words = body.commands[k];
+        if (words.size() == 3 && (words[1] == "argument" || words[1] == "local"))
+        {
+            int index = std::stoi(words[2]);
+            if (words[1] == "local")
+                index += nArgs;
+            words[1] = "temp";
+            words[2] = std::to_string(INLINE_TEMP_BASE + index);
+        }
+        else if (thisAsThat && words.size() == 3 && words[1] == "this")
+            words[1] = "that";
+        commands.push_back(words);
+    }
+
+    // The result is on top of the stack, restore the caller's this below it.
+    if (saveThis)
+    {
+        commands.push_back({"push", "temp", std::to_string(INLINE_THIS_TEMP)});
+        commands.push_back({"pop", "pointer", "0"});
+    }
+    return commands;
+}
+
 auto CompilationEngine::write(TokenType type, std::string data) -> void
 {
     auto type_str = this->tokenTypeToString(type);
@@ -156,6 +234,7 @@ auto CompilationEngine::compileSubroutine(int nFields, FunctionType functionType
     this->write("<subroutineDec>");
     mDepth++;
     mSymbolTable->startSubroutine(mTokenizer->token(), mClassName);
+    mVMWriter->setSourceLine(mTokenizer->lineNumber());
 
     // function void main (
     this->write(mTokenizer->tokenType(), mTokenizer->token());
@@ -188,6 +267,7 @@ auto CompilationEngine::compileSubroutineBody(std::string name, int nFields,
     // subroutineBody
     this->write("<subroutineBody>");
     mDepth++;
+    mFunctionType = functionType;
 
     // {
     mTokenizer->advance();
@@ -260,6 +340,8 @@ auto CompilationEngine::compileStatements() -> void
 
     while (mTokenizer->token() != "}")
     {
+        // Source maps are kept per statement.
+        mVMWriter->setSourceLine(mTokenizer->lineNumber());
         if (mTokenizer->token() == "let")
         {
             this->compileLet();
@@ -441,7 +523,7 @@ auto CompilationEngine::compileTerm() -> void
                     (className != "Main") && (nArgs == 0) &&
                     (funcName.find("new") == std::string::npos))
                     nArgs++;
-                mVMWriter->writeCall(className + "." + funcName, nArgs);
+                this->writeCall(className + "." + funcName, nArgs);
                 isFuncCall = false;
             }
         }
@@ -574,7 +656,7 @@ auto CompilationEngine::compileDo() -> void
         nArgs++;
 
     // Write the function call.
-    mVMWriter->writeCall(callClass + "." + callMethod, nArgs);
+    this->writeCall(callClass + "." + callMethod, nArgs);
 
     // Pop the implicit returned 0
     // TODO: Only for void functions!
@@ -588,6 +670,7 @@ auto CompilationEngine::compileWhile() -> void
 {
     this->write("<whileStatement>");
     mDepth++;
+    int line = mTokenizer->lineNumber();
     this->write(mTokenizer->tokenType(), mTokenizer->token());
     mTokenizer->advance();
     // Label L1
@@ -617,7 +700,8 @@ auto CompilationEngine::compileWhile() -> void
             this->compileStatements();
         }
     }
-    // goto L1
+    // goto L1, belongs to the loop header rather than its last statement
+    mVMWriter->setSourceLine(line);
     mVMWriter->writeGoto("WHILE_START" + std::to_string(localLabelCounter));
 
     // label L2
@@ -643,10 +727,11 @@ auto CompilationEngine::compileReturn() -> void
         terms = this->compileExpression();
     }
 
-    // Push return 0 constant
+    // Void subroutines return 0
     if (terms == 0)
-        mVMWriter->writePush(Segment::CONST, 0);
-    mVMWriter->writeReturn();
+        mVMWriter->writeVoidReturn();
+    else
+        mVMWriter->writeReturn();
 
     // ;
     this->write(mTokenizer->tokenType(), mTokenizer->token());
@@ -662,6 +747,7 @@ auto CompilationEngine::compileIf() -> bool
     // ifStatement
     this->write("<ifStatement>");
     mDepth++;
+    int line = mTokenizer->lineNumber();
 
     // if
     this->write(mTokenizer->tokenType(), mTokenizer->token());
@@ -689,7 +775,9 @@ auto CompilationEngine::compileIf() -> bool
     this->write(mTokenizer->tokenType(), mTokenizer->token());
     mTokenizer->advance();
 
-    // goto label L2 = IF_END
+    // goto label L2 = IF_END, like the labels it belongs to the if rather
+    // than the last statement of a branch
+    mVMWriter->setSourceLine(line);
     mVMWriter->writeGoto("IF_END" + std::to_string(localLabelCounter));
 
     // label L1
@@ -708,6 +796,7 @@ auto CompilationEngine::compileIf() -> bool
     }
 
     // label L2 = IF_END
+    mVMWriter->setSourceLine(line);
     mVMWriter->writeLabel("IF_END" + std::to_string(localLabelCounter));
 
     // ifStatement
@@ -0,0 +1,116 @@
+#include "InlineCache.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+auto InlineCache::addBody(std::string const &name, InlineBody body, int nReturns) -> void
+{
+    if (name.empty() || nReturns != 1)
+        return;
+    // The return is dropped, its value stays on the stack.
+    if (body.commands.empty() || body.commands.back()[0] != "return")
+        return;
+    body.commands.pop_back();
+    auto uses = [](std::vector<std::string> const &words, std::string const &segment,
+                   std::string const &index) {
+        return words.size() == 3 && words[1] == segment && words[2] == index;
+    };
+    auto usesThisOrArgument0 = [&](std::vector<std::string> const &words) {
+        return uses(words, "argument", "0") || uses(words, "pointer", "0");
+    };
+    body.thisFromArgument =
+        body.commands.size() >= 2 &&
+        body.commands[0] == std::vector<std::string>{"push", "argument", "0"} &&
+        body.commands[1] == std::vector<std::string>{"pop", "pointer", "0"} &&
+        std::none_of(body.commands.begin() + 2, body.commands.end(), usesThisOrArgument0);
+    // The prologue becomes a single pop.
+    auto size = static_cast<int>(body.commands.size()) - (body.thisFromArgument ? 1 : 0);
+    if (size > INLINE_CALL_SIZE)
+        return;
+    mBodies[name] = body;
+}
+
+auto InlineCache::load(std::string const &vmPath) -> void
+{
+    std::ifstream file(vmPath);
+    if (!file.is_open())
+        throw std::runtime_error("Could not open " + vmPath);
+
+    std::string name;
+    InlineBody body;
+    int nReturns = 0;
+    bool eligible = false;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        // Strip comments and whitespace, split into words.
+        auto comment = line.find("//");
+        if (comment != std::string::npos)
+            line.erase(comment);
+        std::istringstream stream(line);
+        std::vector<std::string> words;
+        std::string word;
+        while (stream >> word)
+            words.push_back(word);
+        if (words.empty())
+            continue;
+
+        if (words[0] == "function")
+        {
+            if (eligible)
+                this->addBody(name, body, nReturns);
+            name = words[1];
+            body = InlineBody{name.substr(0, name.find('.')), std::stoi(words[2]), 0,
+                              {}, false, false, false, false};
+            nReturns = 0;
+            eligible = true;
+            continue;
+        }
+        if (!eligible)
+            continue;
+
+        // Anything after the return would leave more than the result on the stack.
+        if (nReturns > 0)
+            eligible = false;
+        else if (words[0] == "call" || words[0] == "label" || words[0] == "goto" ||
+                 words[0] == "if-goto")
+            eligible = false;
+        else if (words[0] == "return")
+            nReturns++;
+        else if (words[0] == "push" || words[0] == "pop")
+        {
+            if (words[1] == "temp")
+                eligible = false;
+            if (words[1] == "argument")
+                body.nArgsUsed = std::max(body.nArgsUsed, std::stoi(words[2]) + 1);
+            if (words[1] == "static")
+                body.usesStatic = true;
+            if (words[0] == "pop" && words[1] == "pointer" && words[2] == "0")
+                body.setsThis = true;
+            if (words[1] == "that" || (words[1] == "pointer" && words[2] == "1"))
+                body.usesThat = true;
+        }
+        body.commands.push_back(words);
+    }
+    if (eligible)
+        this->addBody(name, body, nReturns);
+}
+
+auto InlineCache::find(std::string const &name, int nArgs, std::string const &callerClass)
+    -> InlineBody const *
+{
+    auto it = mBodies.find(name);
+    if (it == mBodies.end())
+        return nullptr;
+    auto const &body = it->second;
+    // Statics are scoped to the file they were compiled from.
+    if (body.usesStatic && body.className != callerClass)
+        return nullptr;
+    if (body.nArgsUsed > nArgs)
+        return nullptr;
+    // Arguments and locals must fit in the temps left for them.
+    if (nArgs + body.nLocals > INLINE_THIS_TEMP - INLINE_TEMP_BASE)
+        return nullptr;
+    return &body;
+}
@@ -1,11 +1,14 @@
 #include "CompilationEngine.h"
+#include "InlineCache.h"
 #include "JackTokenizer.h"
 #include "SymbolTable.h"
 #include "VMWriter.h"
 #include <boost/algorithm/string/replace.hpp>
 #include <filesystem>
+#include <set>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 inline auto ends_with(std::string const &value, std::string const ending) -> bool
 {
@@ -21,7 +24,8 @@ inline auto create_output_path(std::string &in_path) -> std::string
     return in_path;
 }
 
-void compile(std::string &path)
+void compile(std::string &path, std::shared_ptr<InlineCache> inlineCache = nullptr,
+             bool sourceMap = false, bool bytecode = false, bool peephole = false)
 {
     auto pathOut = create_output_path(path);
     auto pathOutXml = pathOut;
@@ -34,6 +38,13 @@ void compile(std::string &path)
 
     // Writer
     auto vmwriter = std::make_unique<VMWriter>(pathOutVm);
+    if (sourceMap)
+        vmwriter->enableSourceMap(pathOutVm + ".map",
+                                  std::filesystem::path(path).filename().string());
+    if (bytecode)
+        vmwriter->enableBytecode(pathOutVm + "b");
+    if (peephole)
+        vmwriter->enablePeephole();
 
     // Symbol table
     auto symboltable = std::make_unique<SymbolTable>();
@@ -41,6 +52,7 @@ void compile(std::string &path)
     // Compilation Engine
     auto engine = CompilationEngine(std::move(symboltable), std::move(tokenizer),
                                     std::move(vmwriter), pathOutXml);
+    engine.setInlineCache(inlineCache);
 
     // compile a file
     engine.compileClass();
@@ -56,9 +68,29 @@ int main(int argc, char *argv[])
 
     std::string pathOrDir = std::string(argv[1]);
 
+    // Options follow the path.
+    bool inlineCalls = false;
+    bool sourceMap = false;
+    bool bytecode = false;
+    bool peephole = false;
+    for (int i = 2; argv[i] != nullptr; i++)
+    {
+        if (std::string(argv[i]) == "--inline")
+            inlineCalls = true;
+        else if (std::string(argv[i]) == "--source-map")
+            sourceMap = true;
+        else if (std::string(argv[i]) == "--vmb")
+            bytecode = true;
+        else if (std::string(argv[i]) == "--peephole")
+            peephole = true;
+        else
+            throw std::invalid_argument("Unknown option: " + std::string(argv[i]));
+    }
+
+    std::vector<std::string> paths;
     if (ends_with(pathOrDir, std::string{".jack"}))
     {
-        compile(pathOrDir);
+        paths.push_back(pathOrDir);
     }
     else
     {
@@ -67,8 +99,30 @@ int main(int argc, char *argv[])
         {
             std::string path = dirEntry.path();
             if (path.ends_with(".jack"))
-                compile(path);
+                paths.push_back(path);
         }
     }
+
+    for (auto &path : paths)
+        compile(path, nullptr, sourceMap, bytecode, peephole);
+
+    if (inlineCalls)
+    {
+        // Second pass: the first one produced the bodies to inline, together with
+        // any other .vm file next to the sources, e.g. the OS.
+        std::set<std::filesystem::path> dirs;
+        for (auto const &path : paths)
+            dirs.insert(std::filesystem::path(path).parent_path());
+
+        auto inlineCache = std::make_shared<InlineCache>();
+        for (auto const &dir : dirs)
+            for (const auto &dirEntry : std::filesystem::directory_iterator(
+                     dir.empty() ? std::filesystem::path(".") : dir))
+                if (dirEntry.path().extension() == ".vm")
+                    inlineCache->load(dirEntry.path());
+
+        for (auto &path : paths)
+            compile(path, inlineCache, sourceMap, bytecode, peephole);
+    }
     return 0;
 }
@@ -16,6 +16,7 @@ auto JackTokenizer::advance() -> void
         if (m_line_it == m_line.end())
         {
             getline(m_file, m_line);
+            m_line_number++;
 
             // Skip if line starts with *
             std::string tmp = m_line;
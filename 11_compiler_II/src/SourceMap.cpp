@@ -0,0 +1,63 @@
+#include "SourceMap.h"
+#include <fstream>
+#include <stdexcept>
+
+inline auto writeVarint(std::string &out, uint64_t value) -> void
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+inline auto zigzag(int64_t value) -> uint64_t
+{
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+auto SourceMap::add(std::string const &file, int line) -> void
+{
+    int index = 0;
+    while (index < static_cast<int>(mFiles.size()) && mFiles[index] != file)
+        index++;
+    if (index == static_cast<int>(mFiles.size()))
+        mFiles.push_back(file);
+    mLocations.push_back(SourceLocation{index, line});
+}
+
+auto SourceMap::write(std::string const &path) -> void
+{
+    std::string out = "HSM1";
+    writeVarint(out, mFiles.size());
+    for (auto &file : mFiles)
+    {
+        writeVarint(out, file.size());
+        out += file;
+    }
+
+    std::vector<std::pair<uint64_t, SourceLocation>> runs;
+    for (auto &location : mLocations)
+    {
+        if (!runs.empty() && runs.back().second.file == location.file &&
+            runs.back().second.line == location.line)
+            runs.back().first++;
+        else
+            runs.push_back({1, location});
+    }
+    writeVarint(out, runs.size());
+    SourceLocation previous{0, 0};
+    for (auto &[length, location] : runs)
+    {
+        writeVarint(out, length);
+        writeVarint(out, zigzag(location.file - previous.file));
+        writeVarint(out, zigzag(location.line - previous.line));
+        previous = location;
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("Could not open " + path);
+    file << out;
+}
@@ -0,0 +1,115 @@
+#include "VMBytecode.h"
+#include <fstream>
+#include <stdexcept>
+
+// Codes of the file format, the position in the list is the code.
+inline const std::vector<std::string> typeCodes{
+    "push", "pop", "", "label", "goto", "if-goto", "function", "call", "return",
+};
+
+inline const std::vector<std::string> segmentCodes{
+    "constant", "argument", "local", "static", "this", "that", "pointer", "temp",
+};
+
+inline const std::vector<std::string> arithmeticCodes{
+    "add", "sub", "neg", "eq", "gt", "lt", "and", "or", "not",
+};
+
+inline auto codeOf(std::vector<std::string> const &codes, std::string const &word) -> int
+{
+    for (size_t i = 0; i < codes.size(); i++)
+        if (!codes[i].empty() && codes[i] == word)
+            return static_cast<int>(i);
+    return -1;
+}
+
+inline auto putWord(std::string &out, uint32_t value) -> void
+{
+    for (int shift = 0; shift < 32; shift += 8)
+        out.push_back(static_cast<char>(value >> shift));
+}
+
+auto VMBytecode::name(std::string const &value) -> uint32_t
+{
+    auto found = mOffsets.find(value);
+    if (found != mOffsets.end())
+        return found->second;
+    auto offset = static_cast<uint32_t>(mStrings.size());
+    mStrings += value;
+    mStrings.push_back('\0');
+    mOffsets[value] = offset;
+    return offset;
+}
+
+auto VMBytecode::add(std::vector<std::string> const &words) -> void
+{
+    if (words.empty())
+        throw std::runtime_error("Empty VM command");
+    auto keyword = words[0];
+    int type = codeOf(typeCodes, keyword);
+    int kind = 0;
+    uint32_t count = 0;
+    uint32_t arg = 0;
+    size_t expected = 2;
+    if (type < 0)
+    {
+        // Arithmetic commands are typed by their kind.
+        kind = codeOf(arithmeticCodes, keyword);
+        if (kind < 0)
+            throw std::runtime_error("Unknown VM command: " + keyword);
+        type = 2;
+        expected = 1;
+    }
+    else if (keyword == "return")
+        expected = 1;
+    else if (keyword == "push" || keyword == "pop" || keyword == "function" ||
+             keyword == "call")
+        expected = 3;
+    if (words.size() != expected)
+        throw std::runtime_error("Malformed VM command: " + keyword);
+
+    if (keyword == "push" || keyword == "pop")
+    {
+        kind = codeOf(segmentCodes, words[1]);
+        if (kind < 0)
+            throw std::runtime_error("Unknown segment: " + words[1]);
+        arg = static_cast<uint32_t>(std::stoi(words[2]));
+    }
+    else if (expected == 3)
+    {
+        count = static_cast<uint32_t>(std::stoi(words[2]));
+        arg = this->name(words[1]);
+    }
+    else if (expected == 2)
+    {
+        arg = this->name(words[1]);
+    }
+
+    if (keyword == "function")
+    {
+        putWord(mFunctions, arg);
+        putWord(mFunctions, mCommandCount);
+        putWord(mFunctions, count);
+        mFunctionCount++;
+    }
+    mCommands.push_back(static_cast<char>(type));
+    mCommands.push_back(static_cast<char>(kind));
+    mCommands.push_back(static_cast<char>(count & 0xff));
+    mCommands.push_back(static_cast<char>((count >> 8) & 0xff));
+    putWord(mCommands, arg);
+    mCommandCount++;
+}
+
+auto VMBytecode::write(std::string const &path) -> void
+{
+    std::string out = "VMB1";
+    putWord(out, mCommandCount);
+    putWord(out, mFunctionCount);
+    putWord(out, static_cast<uint32_t>(mStrings.size()));
+    out += mFunctions + mCommands + mStrings;
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("Could not open " + path);
+    file << out;
+}
@@ -1,57 +1,101 @@
 #include "VMWriter.h"
 #include "definitions.h"
 #include <iostream>
+#include <sstream>
 
 auto VMWriter::writePush(Segment segment, int index) -> void
 {
-    mOutputFile << "push ";
-    mOutputFile << segmentToString[segment] << " ";
-    mOutputFile << std::to_string(index) << std::endl;
+    this->writeCommand({"push", segmentToString[segment], std::to_string(index)});
 };
 
 auto VMWriter::writePop(Segment segment, int index) -> void
 {
-    mOutputFile << "pop ";
-    mOutputFile << segmentToString[segment] << " ";
-    mOutputFile << std::to_string(index) << std::endl;
+    this->writeCommand({"pop", segmentToString[segment], std::to_string(index)});
 };
 
 auto VMWriter::writeArithmetic(std::string command) -> void
 {
-    mOutputFile << commandToString[command] << std::endl;
+    // Multiplication and division are calls of several words.
+    std::vector<std::string> words;
+    std::istringstream stream(commandToString[command]);
+    for (std::string word; stream >> word;)
+        words.push_back(word);
+    this->writeCommand(words);
 };
 
 auto VMWriter::writeLabel(std::string label) -> void
 {
-    mOutputFile << "label " << label << std::endl;
+    this->writeCommand({"label", label});
 };
 
 auto VMWriter::writeGoto(std::string label) -> void
 {
-    mOutputFile << "goto " << label << std::endl;
+    this->writeCommand({"goto", label});
 };
 
 auto VMWriter::writeIf(std::string label) -> void
 {
-    mOutputFile << "if-goto " << label << std::endl;
+    this->writeCommand({"if-goto", label});
 };
 
 auto VMWriter::writeCall(std::string name, int nArgs) -> void
 {
-    mOutputFile << "call ";
-    mOutputFile << name;
-    mOutputFile << " " << std::to_string(nArgs) << std::endl;
+    this->writeCommand({"call", name, std::to_string(nArgs)});
 };
 
 auto VMWriter::writeFunction(std::string className, std::string functionName,
                              int nLocals) -> void
 {
-    mOutputFile << "function ";
-    mOutputFile << className << "." << functionName << " ";
-    mOutputFile << std::to_string(nLocals) << std::endl;
+    this->writeCommand({"function", className + "." + functionName, std::to_string(nLocals)});
 };
 
 auto VMWriter::writeReturn() -> void
 {
-    mOutputFile << "return" << std::endl;
+    this->writeCommand({"return"});
+};
+
+auto VMWriter::writeVoidReturn() -> void
+{
+    if (mPeephole && mHeld == std::vector<std::string>{"pop", "temp", "0"})
+        mHeld.clear();
+    else
+        this->writePush(Segment::CONST, 0);
+    this->writeReturn();
+};
+
+auto VMWriter::writeCommand(std::vector<std::string> const &words) -> void
+{
+    if (!mPeephole)
+    {
+        this->emit(words, mSourceLine);
+        return;
+    }
+    bool isNot = words.size() == 1 && words[0] == "not";
+    if (!mHeld.empty())
+    {
+        bool cancels = isNot && mHeld.size() == 1 && mHeld[0] == "not";
+        auto held = std::move(mHeld);
+        mHeld.clear();
+        if (cancels)
+            return;
+        this->emit(held, mHeldLine);
+    }
+    if (isNot || words == std::vector<std::string>{"pop", "temp", "0"})
+    {
+        mHeld = words;
+        mHeldLine = mSourceLine;
+        return;
+    }
+    this->emit(words, mSourceLine);
+};
+
+auto VMWriter::emit(std::vector<std::string> const &words, int line) -> void
+{
+    if (!mSourceMapPath.empty())
+        mSourceMap.add(mSourceName, line);
+    if (!mBytecodePath.empty())
+        mBytecode.add(words);
+    for (size_t i = 0; i < words.size(); i++)
+        mOutputFile << (i == 0 ? "" : " ") << words[i];
+    mOutputFile << std::endl;
 };
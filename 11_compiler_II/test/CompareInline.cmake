@@ -0,0 +1,32 @@
+# Compiles the Jack program in SOURCE with and without --inline to WORK and
+# checks that both leave the same values at the RAM addresses DUMP (a ;-list)
+# after STEPS steps in the VMEmulator of the toolchain.
+#
+# cmake -DCOMPILER=.. -DVMEMULATOR=.. -DSOURCE=dir -DWORK=dir -DSTEPS=n -DDUMP=.. -P CompareInline.cmake
+
+file(REMOVE_RECURSE ${WORK})
+file(GLOB SOURCES ${SOURCE}/*.jack)
+foreach(MODE call inline)
+    file(MAKE_DIRECTORY ${WORK}/${MODE})
+    file(COPY ${SOURCES} DESTINATION ${WORK}/${MODE})
+    set(FLAGS "")
+    if(MODE STREQUAL inline)
+        set(FLAGS --inline)
+    endif()
+    execute_process(COMMAND ${COMPILER} ${WORK}/${MODE} ${FLAGS} RESULT_VARIABLE RESULT)
+    if(NOT RESULT EQUAL 0)
+        message(FATAL_ERROR "JackCompiler failed on ${SOURCE} ${FLAGS}")
+    endif()
+    execute_process(COMMAND ${VMEMULATOR} ${WORK}/${MODE} -s ${STEPS} --dump ${DUMP}
+                    OUTPUT_VARIABLE OUTPUT RESULT_VARIABLE RESULT)
+    if(NOT RESULT EQUAL 0)
+        message(FATAL_ERROR "VMEmulator failed on ${WORK}/${MODE}")
+    endif()
+    # The table of the dumped values, without the statistics line.
+    string(REGEX MATCHALL "\\|[^\n]*" TABLE "${OUTPUT}")
+    set(TABLE_${MODE} "${TABLE}")
+endforeach()
+
+if(NOT TABLE_call STREQUAL TABLE_inline)
+    message(FATAL_ERROR "--inline changed the results:\n${TABLE_call}\n${TABLE_inline}")
+endif()
@@ -0,0 +1,23 @@
+# Compiles the Jack program in SOURCE to WORK without options and checks that
+# every .vm file is the same as the one tracked next to the sources.
+#
+# cmake -DCOMPILER=.. -DSOURCE=dir -DWORK=dir -P CompareVM.cmake
+
+file(REMOVE_RECURSE ${WORK})
+file(MAKE_DIRECTORY ${WORK})
+file(GLOB SOURCES ${SOURCE}/*.jack)
+file(COPY ${SOURCES} DESTINATION ${WORK})
+execute_process(COMMAND ${COMPILER} ${WORK} RESULT_VARIABLE RESULT)
+if(NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "JackCompiler failed on ${SOURCE}")
+endif()
+
+foreach(JACK ${SOURCES})
+    get_filename_component(NAME ${JACK} NAME_WE)
+    execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files
+                            ${SOURCE}/${NAME}.vm ${WORK}/${NAME}.vm
+                    RESULT_VARIABLE RESULT)
+    if(NOT RESULT EQUAL 0)
+        message(FATAL_ERROR "${WORK}/${NAME}.vm differs from ${SOURCE}/${NAME}.vm")
+    endif()
+endforeach()
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// Peephole passes over Hack assembly, before it is assembled.
+//
+// Works on the stripped instructions and labels of one program or object, each
+// with its source line. Code addresses must be labels, or numbers jumped to
+// directly (@133 0;JMP), which are turned into labels first. Numbers that are
+// only stored and jumped to later are taken as data and not relocated.
+class AsmOptimizer
+{
+private:
+    std::vector<std::pair<std::string, int>> &mLines;
+
+    // Give every numeric jump target a label.
+    auto labelCodeAddresses() -> void;
+
+    // Drop A-instructions loading what A already holds and D=M or M=D when D
+    // and RAM[A] are known to be equal. Knowledge ends at labels.
+    auto removeRedundantLoads() -> int;
+
+    // Replace known instruction sequences by shorter equivalent ones, such as a
+    // push of D followed by a pop into D.
+    auto rewriteSequences() -> int;
+
+    // Jump straight to the end of a chain of unconditional jumps.
+    auto threadJumps() -> int;
+
+    // Drop code after an unconditional jump up to the next label, and jumps to
+    // the next instruction.
+    auto removeDeadCode() -> int;
+
+public:
+    AsmOptimizer(std::vector<std::pair<std::string, int>> &lines) : mLines(lines){};
+
+    // Run all passes until nothing changes. Returns the number of removed
+    // instructions.
+    auto optimize() -> int;
+};
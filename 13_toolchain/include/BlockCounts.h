@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+
+struct CommandCount
+{
+    uint64_t count; // Executions of the command
+    uint64_t taken; // Executions that continued elsewhere than at the next command
+};
+
+struct ClassCounts
+{
+    int nCommands; // Commands of the profiled .vm file, labels included
+    std::map<int, CommandCount> commands; // By index into the commands of the file
+};
+
+// Execution counts of the VM commands of a profiled run, for profile guided
+// passes such as VMOptimizer::layoutBlocks. Stored as text, per class a line
+// "class Ball 523" with its number of commands, followed by a line
+// "index count taken" per executed command.
+class BlockCounts
+{
+private:
+    std::map<std::string, ClassCounts> mClasses;
+
+public:
+    BlockCounts() : mClasses(){};
+
+    auto add(std::string const &className, int nCommands, int index, CommandCount count)
+        -> void;
+
+    // Whether the class was profiled, changed since or not.
+    auto contains(std::string const &className) const -> bool;
+
+    // Counts of a class, nullptr if it was not profiled or has changed since.
+    auto find(std::string const &className, int nCommands) const -> ClassCounts const *;
+
+    auto read(std::string const &path) -> void;
+
+    auto write(std::string const &path) -> void;
+};
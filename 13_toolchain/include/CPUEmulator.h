@@ -0,0 +1,173 @@
+#pragma once
+
+#include "HackJIT.h"
+#include "Profiler.h"
+#include "definitions.h"
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Micro-op handlers, one per canonical comp code and source of y.
+enum class MicroOpHandler : uint8_t
+{
+    LOAD, // A-instruction
+    ZERO,
+    ONE,
+    MINUS_ONE,
+    D,
+    A,
+    M,
+    NOT_D,
+    NOT_A,
+    NOT_M,
+    NEG_D,
+    NEG_A,
+    NEG_M,
+    D_PLUS_1,
+    A_PLUS_1,
+    M_PLUS_1,
+    D_MINUS_1,
+    A_MINUS_1,
+    M_MINUS_1,
+    D_PLUS_A,
+    D_PLUS_M,
+    D_MINUS_A,
+    D_MINUS_M,
+    A_MINUS_D,
+    M_MINUS_D,
+    D_AND_A,
+    D_AND_M,
+    D_OR_A,
+    D_OR_M,
+    GENERIC, // Comp code outside the table
+    STOP     // Past the end of the ROM
+};
+
+// A ROM word decoded once at load time.
+struct MicroOp
+{
+    MicroOpHandler handler;
+    uint8_t dest; // A, D, M bits
+    uint8_t jump; // lt, eq, gt bits
+    bool mayHalt; // Jumping back to pc - 1 is the halt idiom
+    int16_t value; // A-instruction constant or the raw C-instruction
+};
+
+// Executes Hack machine code.
+//
+// ROM and RAM are flat arrays of 16-bit words. A program ends when it runs off
+// the end of the ROM, when it reaches the usual halt idiom (an unconditional
+// jump to itself, e.g. (END) @END 0;JMP), or when the cycle limit is hit.
+// Interpreted and translated runs agree cycle by cycle. The interpreter works
+// on micro-ops decoded once per ROM with the fields already extracted.
+class CPUEmulator
+{
+private:
+    std::vector<uint16_t> mRom;
+    std::vector<MicroOp> mDecoded;
+    std::vector<int16_t> mRam;
+    int16_t mA;
+    int16_t mD;
+    uint16_t mPc;
+    uint64_t mCycles;
+    bool mHalted;
+    std::unique_ptr<HackJIT> mJit;
+    Profiler *mProfiler;
+
+    auto decode() -> void;
+
+    auto interpret(uint64_t maxCycles) -> uint64_t;
+
+    auto runJit(uint64_t maxCycles) -> uint64_t;
+
+    auto runProfiled(uint64_t maxCycles) -> uint64_t;
+
+    auto programHash() -> uint64_t;
+
+public:
+    CPUEmulator()
+        : mRom(), mDecoded(65536, MicroOp{MicroOpHandler::STOP, 0, 0, false, 0}),
+          mRam(RAM_SIZE, 0), mA(0), mD(0), mPc(0), mCycles(0), mHalted(false),
+          mJit(nullptr), mProfiler(nullptr){};
+
+    // Run through the x86-64 translator instead of the interpreter. Returns
+    // false if the host does not support it, the interpreter is used then.
+    auto setJit(bool enabled) -> bool;
+
+    // Count every instruction in the profiler, which then takes precedence over
+    // the translator. The profiler is not owned, nullptr turns profiling off.
+    auto setProfiler(Profiler *profiler) -> void
+    {
+        mProfiler = profiler;
+    };
+
+    // Load a .hack file: either text with one 16 character binary word per line
+    // or a binary image of big endian words.
+    auto load(std::string const &path) -> void;
+
+    auto setRom(std::vector<uint16_t> rom) -> void;
+
+    // Reset the CPU registers and the cycle counter, RAM is left as is.
+    auto reset() -> void;
+
+    auto clearRam() -> void;
+
+    // Save RAM and registers, e.g. after the OS has initialized, to resume
+    // runs of the same program from there with restoreSnapshot.
+    auto saveSnapshot(std::string const &path) -> void;
+
+    auto restoreSnapshot(std::string const &path) -> void;
+
+    // Run up to maxCycles instructions, returns the number executed.
+    auto run(uint64_t maxCycles) -> uint64_t;
+
+    auto peek(int address) -> int16_t
+    {
+        return mRam[address & (RAM_SIZE - 1)];
+    };
+
+    auto poke(int address, int16_t value) -> void
+    {
+        mRam[address & (RAM_SIZE - 1)] = value;
+    };
+
+    // Write the given RAM words as the header and row of a .cmp file.
+    auto dumpRam(std::vector<int> const &addresses, std::ostream &out) -> void;
+
+    auto rom() -> std::vector<uint16_t> const &
+    {
+        return mRom;
+    };
+
+    auto ram() -> std::vector<int16_t> &
+    {
+        return mRam;
+    };
+
+    auto a() -> int16_t
+    {
+        return mA;
+    };
+
+    auto d() -> int16_t
+    {
+        return mD;
+    };
+
+    auto pc() -> uint16_t
+    {
+        return mPc;
+    };
+
+    auto cycles() -> uint64_t
+    {
+        return mCycles;
+    };
+
+    auto halted() -> bool
+    {
+        return mHalted;
+    };
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Column header of a .cmp file: the name centered in the column, cut off if it
+// is too long.
+inline auto formatHeader(std::string const &name, int width) -> std::string
+{
+    auto text = name.substr(0, width);
+    auto left = (width - static_cast<int>(text.size())) / 2;
+    return std::string(left, ' ') + text + std::string(width - left - text.size(), ' ');
+}
+
+// Decimal value of a column in the %Dleft.width.right format of output lists.
+inline auto formatDecimal(int16_t value, int left, int width, int right) -> std::string
+{
+    std::ostringstream out;
+    out << std::string(left, ' ') << std::setw(width) << value << std::string(right, ' ');
+    return out.str();
+}
+
+// Write RAM words as the header and row of a .cmp file. Columns are 8
+// characters wide like the course's %D1.6.1 output lists.
+inline auto writeRamDump(std::vector<int16_t> const &ram, std::vector<int> const &addresses,
+                         std::ostream &out) -> void
+{
+    out << "|";
+    for (auto address : addresses)
+        out << formatHeader("RAM[" + std::to_string(address) + "]", 8) << "|";
+    out << std::endl << "|";
+    for (auto address : addresses)
+        out << formatDecimal(ram[address & (ram.size() - 1)], 1, 6, 1) << "|";
+    out << std::endl;
+}
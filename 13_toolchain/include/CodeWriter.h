@@ -0,0 +1,171 @@
+#pragma once
+
+#include "definitions.h"
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+// Lowers VM commands to Hack assembly.
+//
+// The top of the VM stack is cached in the D register whenever possible
+// (mTosInD), so a value produced by one command is consumed by the next one
+// without a round trip through RAM. At every jump target the cache is flushed
+// so all control flow joins in the same state: stack fully in RAM.
+// R13-R15 are used as scratch registers.
+//
+// In size optimized mode calls, returns and comparisons jump to shared
+// routines emitted once at the end of the program instead of being inlined,
+// trading a few cycles per use for a much smaller ROM.
+//
+// With intrinsics calls of Math.multiply and Math.divide jump to shared
+// assembly routines that take their operands in registers instead of a frame,
+// Memory.peek and Memory.poke become plain memory accesses.
+class CodeWriter
+{
+private:
+    std::ofstream mOutputFile;
+    std::string mFileName;
+    std::string mFunctionName;
+    bool mTosInD;
+    int mLabelCounter;
+    int mInstructionCount;
+    bool mSizeOptimized;
+    bool mTailCalls;
+    bool mIntrinsics;
+    std::map<std::string, int> mSharedRoutineUses;
+
+    auto emit(std::string const &instruction) -> void;
+
+    auto emitLabel(std::string const &label) -> void;
+
+    auto uniqueLabel(std::string const &kind) -> std::string;
+
+    auto scopedLabel(std::string const &label) -> std::string;
+
+    auto flush() -> void;
+
+    auto popToD() -> void;
+
+    auto fixedSymbol(Segment segment, int index) -> std::string;
+
+    auto isAddressable(Segment segment, int index, int maxOffset) -> bool;
+
+    auto addressOperand(Segment segment, int index, int maxOffset) -> bool;
+
+    auto loadSegment(Segment segment, int index) -> void;
+
+    auto storeSegment(Segment segment, int index) -> void;
+
+    auto applyBinary(Command command, std::string const &operand) -> void;
+
+    auto writeCompareResult(Command command) -> void;
+
+    auto writeFrameSave() -> void;
+
+    auto writeFrameRestore() -> void;
+
+    auto writeSharedCall(std::string const &functionName, int nArgs) -> void;
+
+    auto copyWord() -> void;
+
+    auto writeTailCall(std::string const &functionName, int nArgs) -> void;
+
+    auto writeSharedCompare(Command command) -> void;
+
+    auto writeIntrinsic(std::string const &functionName, int nArgs) -> bool;
+
+    auto writeSharedMultiply() -> void;
+
+    auto writeSharedDivide() -> void;
+
+    auto matchIntrinsic(std::vector<VMCommand> const &commands, size_t i) -> size_t;
+
+    auto matchBranch(std::vector<VMCommand> const &commands, size_t i) -> size_t;
+
+    auto matchPattern(std::vector<VMCommand> const &commands, size_t i) -> size_t;
+
+public:
+    CodeWriter(std::string outputPath)
+        : mOutputFile(outputPath), mFileName(""), mFunctionName(""), mTosInD(false),
+          mLabelCounter(0), mInstructionCount(0), mSizeOptimized(false), mTailCalls(false),
+          mIntrinsics(false){};
+
+    ~CodeWriter()
+    {
+        if (mOutputFile.is_open())
+            mOutputFile.close();
+    };
+
+    auto setSizeOptimized(bool sizeOptimized) -> void
+    {
+        mSizeOptimized = sizeOptimized;
+    };
+
+    // Lower call f n; return as a jump that reuses the caller's frame, so
+    // recursion in tail position runs in constant stack space.
+    auto setTailCalls(bool tailCalls) -> void
+    {
+        mTailCalls = tailCalls;
+    };
+
+    // Lower calls of Math.multiply, Math.divide, Memory.peek and Memory.poke
+    // without a call frame, see writeIntrinsic.
+    auto setIntrinsics(bool intrinsics) -> void
+    {
+        mIntrinsics = intrinsics;
+    };
+
+    auto setFileName(std::string const &fileName) -> void;
+
+    auto writeInit() -> void;
+
+    auto writeArithmetic(Command command) -> void;
+
+    auto writePush(Segment segment, int index) -> void;
+
+    auto writePop(Segment segment, int index) -> void;
+
+    auto writeLabel(std::string const &label) -> void;
+
+    auto writeGoto(std::string const &label) -> void;
+
+    auto writeIf(std::string const &label) -> void;
+
+    auto writeCall(std::string const &functionName, int nArgs) -> void;
+
+    auto writeReturn() -> void;
+
+    auto writeFunction(std::string const &functionName, int nLocals) -> void;
+
+    // Lower a command sequence, fusing known command patterns.
+    auto translate(std::vector<VMCommand> const &commands) -> void;
+
+    // Emit the routines the size optimized mode jumped to, once each.
+    auto writeSharedRoutines() -> void;
+
+    // Count jumps of other writers, e.g. of other files, to emit their routines.
+    auto addSharedRoutineUses(std::map<std::string, int> const &uses) -> void
+    {
+        for (auto &[routine, count] : uses)
+            mSharedRoutineUses[routine] += count;
+    };
+
+    // Number of jumps into each shared routine.
+    auto sharedRoutineUses() -> std::map<std::string, int> const &
+    {
+        return mSharedRoutineUses;
+    };
+
+    // Number of emitted A- and C-instructions, i.e. the ROM size.
+    auto instructionCount() -> int
+    {
+        return mInstructionCount;
+    };
+
+    auto close() -> void
+    {
+        if (mOutputFile.is_open())
+            mOutputFile.close();
+    };
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "HackObject.h"
+#include "SourceMap.h"
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Translates Hack assembly into machine code.
+//
+// The usual two passes: labels are collected first, variables are allocated
+// from RAM[16] on their first use in the second pass. Commutative comps may be
+// written either way round (D+A or A+D) and dest registers in any order.
+class HackAssembler
+{
+private:
+    std::unordered_map<std::string, int> mSymbols;
+    std::unordered_map<std::string, int> mLabels;
+    std::unordered_map<std::string, int> mExternals; // Index into the object's externals
+    SourceMap mSourceMap;
+    int mNextVariable;
+    bool mPeephole;
+    int mRemoved;
+
+    auto resolve(std::string const &symbol) -> int;
+
+    // Value of a symbol at the given address of an object, records a relocation
+    // unless it is predefined.
+    auto relocate(std::string const &symbol, int address, HackObject &object) -> int;
+
+    // Without an object symbols are resolved as for a whole program.
+    auto translate(std::istream &source, std::string const &name, HackObject *object)
+        -> std::vector<uint16_t>;
+
+public:
+    HackAssembler()
+        : mSymbols(), mLabels(), mExternals(), mSourceMap(), mNextVariable(16),
+          mPeephole(false), mRemoved(0){};
+
+    // Run the AsmOptimizer over the source before assembling it.
+    auto setPeephole(bool peephole) -> void
+    {
+        mPeephole = peephole;
+    };
+
+    // Instructions the optimizer removed from the last assembled program.
+    auto removedInstructions() -> int
+    {
+        return mRemoved;
+    };
+
+    // Assemble a whole program, errors are reported with name and line.
+    auto assemble(std::istream &source, std::string const &name) -> std::vector<uint16_t>;
+
+    // Assemble one part of a program into a relocatable object for ObjectLinker.
+    auto assembleObject(std::istream &source, std::string const &name) -> HackObject;
+
+    auto load(std::string const &path) -> std::vector<uint16_t>;
+
+    // ROM address of every label of the last assembled program.
+    auto labels() -> std::unordered_map<std::string, int> const &
+    {
+        return mLabels;
+    };
+
+    // Source line of every word of the last assembled program.
+    auto sourceMap() -> SourceMap const &
+    {
+        return mSourceMap;
+    };
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "definitions.h"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+// Translates basic blocks of Hack machine code into x86-64 code.
+//
+// A block runs up to and including the first jump. Blocks are compiled on
+// first use and cached per start address. A jump whose target is known at
+// compile time (set by an @ instruction of the same block) is chained: it is
+// patched to jump straight into the target block once that block exists.
+// Other jumps look the target up in a table of compiled blocks and only leave
+// native code when the target is not compiled yet.
+//
+// Hack registers live in host registers while native code runs: A in r12d,
+// D in r13d, the remaining cycle budget in r14, the RAM base in r15 and the
+// block table in rbp. Instructions outside the canonical comp table are left
+// to the interpreter.
+class HackJIT
+{
+public:
+    // Machine state shared with the native code.
+    struct State
+    {
+        int32_t a;
+        int32_t d;
+        int64_t remaining; // Cycle budget, blocks only run if they fit
+        int16_t *ram;
+        void **table;
+        uint32_t pc;
+    };
+
+private:
+    uint8_t *mCode;
+    size_t mCodeSize;
+    size_t mCodeUsed;
+    size_t mRuntimeSize; // Entry and exit routines at the start of mCode
+    size_t mExitOffset;
+    std::vector<uint16_t> mRom;
+    std::vector<void *> mTable;
+    std::vector<int> mBlockLength;
+    std::map<uint16_t, std::vector<size_t>> mPendingChains;
+
+    auto emit(std::initializer_list<uint8_t> bytes) -> void;
+
+    auto emit32(uint32_t value) -> void;
+
+    auto emitJump(uint8_t const *opcode, size_t opcodeSize, size_t target) -> size_t;
+
+    auto patch(size_t rel32Offset, size_t target) -> void;
+
+    auto emitRuntime() -> void;
+
+    auto emitExit(uint16_t pc, int status) -> void;
+
+    auto emitComp(int comp) -> void;
+
+    auto isCompilable(uint16_t instruction) -> bool;
+
+    auto flush() -> void;
+
+public:
+    HackJIT();
+
+    ~HackJIT();
+
+    HackJIT(HackJIT const &) = delete;
+
+    auto operator=(HackJIT const &) -> HackJIT & = delete;
+
+    // False when no executable memory could be mapped or the host is not x86-64.
+    auto available() -> bool
+    {
+        return mCode != nullptr;
+    };
+
+    auto setRom(std::vector<uint16_t> const &rom) -> void;
+
+    // Compile the block at pc if needed, false if pc has to be interpreted.
+    auto compile(uint16_t pc) -> bool;
+
+    auto blockLength(uint16_t pc) -> int
+    {
+        return mBlockLength[pc];
+    };
+
+    // Run native code from state.pc until it needs the dispatcher again.
+    // Returns true if the program reached the halt idiom.
+    auto execute(State &state) -> bool;
+};
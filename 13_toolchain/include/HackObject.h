@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Relocatable Hack machine code of one assembly file, e.g. one class.
+//
+// Code is placed at address 0 of the object. Words that hold the address of one
+// of the object's own labels get the object's base address added when linked.
+// Symbols the object uses without defining them are external: a label of
+// another object, or a variable if no object defines it. The externals in order
+// of first use are the object's static section, variables among them are
+// allocated object by object when linking.
+struct HackObject
+{
+    std::string name;
+    std::vector<uint16_t> code;
+    std::vector<std::pair<std::string, int>> labels; // Every label and its offset
+    std::vector<uint16_t> localRelocations;          // Words holding an offset into code
+    std::vector<std::string> externals;
+    std::vector<std::pair<uint16_t, int>> externalRelocations; // Word, index into externals
+
+    // Binary file, "HOB1" followed by the fields above as little endian words,
+    // counts and offsets, strings with their length first.
+    auto write(std::string const &path) const -> void;
+
+    auto read(std::string const &path) -> void;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+struct KeyEvent
+{
+    uint64_t cycle; // Cycle or VM step from which on the key is held
+    int16_t key;    // Hack key code, 0 for no key
+};
+
+// Keyboard input of a run, replayed through KBD (RAM[24576]).
+//
+// One event per line, "cycle key", in increasing order of cycles:
+//
+//     // Move the bat to the right for 2 million cycles
+//     1000000 right
+//     3000000 release
+//
+// A key is a single character, a name from the Hack keyboard (newline,
+// backspace, left, up, right, down, home, end, pageup, pagedown, insert,
+// delete, esc, f1 to f12, and space) or a key code such as #130. It is held
+// until the next event, release lets go of it. Cycles count from the start of
+// the program, so the same script gives the same run, also after a restore.
+class InputScript
+{
+private:
+    std::vector<KeyEvent> mEvents;
+
+public:
+    InputScript() : mEvents(){};
+
+    auto load(std::string const &path) -> void;
+
+    auto empty() -> bool
+    {
+        return mEvents.empty();
+    };
+
+    // The key held at the given cycle.
+    auto keyAt(uint64_t cycle) -> int16_t;
+
+    // Cycle of the first event after the given one, max if there is none.
+    auto nextEvent(uint64_t cycle) -> uint64_t;
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// A whole file mapped read-only into memory, or read into a buffer on hosts
+// without mmap. Unmapped when destroyed.
+class MappedFile
+{
+private:
+    char const *mData;
+    size_t mSize;
+    std::string mBuffer; // Contents if the file is not mapped
+
+public:
+    MappedFile(std::string const &path);
+
+    ~MappedFile();
+
+    MappedFile(MappedFile const &) = delete;
+
+    auto operator=(MappedFile const &) -> MappedFile & = delete;
+
+    auto data() const -> char const *
+    {
+        return mData;
+    };
+
+    auto size() const -> size_t
+    {
+        return mSize;
+    };
+};
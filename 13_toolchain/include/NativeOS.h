@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+inline constexpr int MAX_NATIVE_ARGS = 2;
+
+// An OS function run as C++ in place of its VM code. It gets the arguments,
+// in order, and the whole RAM, and returns false for arguments whose result
+// is left to the OS implementation, e.g. division by zero, so the VM code
+// runs after all.
+struct NativeFunction
+{
+    std::string name;
+    int nArgs;
+    auto (*call)(int16_t const *args, int16_t *ram, int16_t &result) -> bool;
+};
+
+// The OS functions with a native version: Math.abs, multiply, divide, min, max
+// and sqrt, Memory.peek and poke. Their results do not depend on the state of
+// the OS, so they equal those of any correct OS implementation.
+auto nativeFunctions() -> std::vector<NativeFunction> const &;
+
+// Index into nativeFunctions, -1 if the function has no native version.
+auto findNative(std::string const &name, int nArgs) -> int;
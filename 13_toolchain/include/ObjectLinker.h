@@ -0,0 +1,38 @@
+#pragma once
+
+#include "HackObject.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Combines relocatable objects into one program.
+//
+// Objects are placed one after the other in the order they are added. Linking
+// is a single pass over the relocations once all labels are known: own labels
+// get the object's base address added, externals become the label of that name
+// or, if no object defines one, a variable. Variables are allocated from
+// RAM[16] in order of first use, object by object, so the result equals the
+// assembly of the concatenated sources.
+class ObjectLinker
+{
+private:
+    std::vector<HackObject> mObjects;
+    std::vector<int> mBases;
+    int mSize;
+    std::unordered_map<std::string, int> mLabels;
+
+public:
+    ObjectLinker() : mObjects(), mBases(), mSize(0), mLabels(){};
+
+    auto add(HackObject object) -> void;
+
+    // Throws on labels defined by two objects and programs larger than the ROM.
+    auto link() -> std::vector<uint16_t>;
+
+    // ROM address of every label of the linked program.
+    auto labels() -> std::unordered_map<std::string, int> const &
+    {
+        return mLabels;
+    };
+};
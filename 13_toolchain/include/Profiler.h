@@ -0,0 +1,124 @@
+#pragma once
+
+#include "SourceMap.h"
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct CallCount
+{
+    uint64_t calls;
+    uint64_t cycles; // Inclusive, spent in the callee and everything it called
+};
+
+// Attributes executed instructions to the functions of a program.
+//
+// Counts are kept per code address, a ROM address or a VM bytecode index, and
+// summed up per function by address for the flat profile. The emulators report
+// calls and returns, which maintain a shadow call stack for the call graph and
+// the folded stacks. Code outside of any function is reported as (start).
+class Profiler
+{
+private:
+    std::vector<std::string> mFunctionNames;
+    std::vector<int> mFunctionOf; // Index into mFunctionNames per address, 0 is (start)
+    std::vector<bool> mIsEntry;   // Hack code: jumping here calls a function
+    std::vector<bool> mIsReturn;  // Hack code: jumping here returns from one
+    std::vector<uint64_t> mCounts;
+    std::vector<uint64_t> mTaken; // Jumps, calls and returns per address
+    int mLast;                    // Address counted last, -1 before the first
+    uint64_t mCycles;
+    std::vector<int> mStack;
+    std::vector<uint64_t> mEntryCycles;
+    uint64_t mSampledCycles;
+    std::map<std::vector<int>, uint64_t> mStackCycles;
+    std::map<std::pair<int, int>, CallCount> mCalls;
+    std::vector<CallCount> mTotals;
+    SourceMap mSources;
+
+    // Attribute the cycles since the last call or return to the current stack.
+    auto sample() -> void;
+
+    // Close the frame on top of the stack, until is the current cycle.
+    auto close(size_t depth, uint64_t until, std::map<std::pair<int, int>, CallCount> &calls,
+               std::vector<CallCount> &totals) -> void;
+
+public:
+    // Functions of VM bytecode: a function index per instruction, -1 outside
+    // of functions.
+    Profiler(std::vector<std::string> functionNames, std::vector<int> functionOf);
+
+    // Functions of Hack code, from the labels VMTranslator gives its assembly.
+    // Labels with a dot and without $ start a function (Class.function), the
+    // return addresses of calls (Class.function$ret.N) mark returns. Shared
+    // routines of the size optimized mode ($CALL, $RETURN, ...) are counted as
+    // functions of their own in the flat profile.
+    Profiler(std::unordered_map<std::string, int> const &labels, size_t codeSize);
+
+    // Source lines of the code addresses, for the hottest lines of the flat profile.
+    auto setSources(SourceMap sources) -> void
+    {
+        mSources = std::move(sources);
+    };
+
+    auto count(int address) -> void
+    {
+        if (mStack.empty())
+        {
+            mStack.push_back(mFunctionOf[address]);
+            mEntryCycles.push_back(mCycles);
+        }
+        if (mLast >= 0 && address != mLast + 1)
+            mTaken[mLast]++;
+        mLast = address;
+        mCounts[address]++;
+        mCycles++;
+    };
+
+    // Enter the function starting at entry.
+    auto call(int entry) -> void;
+
+    auto ret() -> void;
+
+    // A jump taken in Hack code, a call or return if it lands on a marked label.
+    auto jump(int target) -> void
+    {
+        if (static_cast<size_t>(target) >= mIsEntry.size())
+            return;
+        if (mIsEntry[target])
+            this->call(target);
+        else if (mIsReturn[target])
+            this->ret();
+    };
+
+    auto cycles() -> uint64_t
+    {
+        return mCycles;
+    };
+
+    // Executions per address.
+    auto counts() -> std::vector<uint64_t> const &
+    {
+        return mCounts;
+    };
+
+    // Executions per address that did not continue at the next address.
+    auto taken() -> std::vector<uint64_t> const &
+    {
+        return mTaken;
+    };
+
+    // Instructions per function, hottest first, the hottest addresses and, with
+    // sources, the hottest source lines.
+    auto writeFlat(std::ostream &out, int addresses = 20) -> void;
+
+    // Per function its callers and callees with call counts and inclusive cycles.
+    auto writeCallGraph(std::ostream &out) -> void;
+
+    // One line per call stack, "Sys.init;Main.main;Math.multiply 1234", for
+    // flamegraph tools.
+    auto writeFolded(std::ostream &out) -> void;
+};
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "definitions.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Headless access to the Hack screen, RAM[SCREEN_BASE] and the following
+// SCREEN_WORDS words. Each word holds 16 pixels, the least significant bit is
+// the leftmost one and a set bit is black.
+
+// Screen rows with 1 bit per pixel, leftmost pixel in the most significant
+// bit, 1 is black: the pixel layout of PBM. Takes SCREEN_WORDS * 2 bytes.
+auto packScreen(int16_t const *screen, uint8_t *rows) -> void;
+
+// Hash of the screen contents, to compare frames without storing them.
+auto screenHash(int16_t const *screen) -> uint64_t;
+
+// Path of the frame-th image of a sequence: pong.png becomes pong.00042.png.
+auto framePath(std::string const &path, int frame) -> std::string;
+
+// Write the screen as a binary PBM, or as a 1 bit grayscale PNG if path ends in .png.
+auto writeScreen(std::string const &path, int16_t const *screen) -> void;
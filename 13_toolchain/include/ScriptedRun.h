@@ -0,0 +1,60 @@
+#pragma once
+
+#include "InputScript.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Parse "addr=value" of a --set option.
+auto parseAssignment(std::string const &arg) -> std::pair<int, int>;
+
+// The run loop of the emulators: runs a program for a number of cycles or VM
+// steps while replaying an InputScript through KBD, and captures the screen
+// after every frame and at the end of the run.
+//
+// Runs stop at every key event and frame end. The program counts from its
+// start, a restored run included, the run loop from its first call.
+class ScriptedRun
+{
+private:
+    InputScript mInput;
+    uint64_t mFrameSteps; // 0 without frames
+    std::string mScreenshotPath;
+    bool mScreenHashes;
+    int mFrame;
+
+public:
+    ScriptedRun()
+        : mInput(), mFrameSteps(0), mScreenshotPath(), mScreenHashes(false), mFrame(0){};
+
+    auto setInput(InputScript const &input) -> void
+    {
+        mInput = input;
+    };
+
+    auto setFrames(uint64_t frameSteps) -> void
+    {
+        mFrameSteps = frameSteps;
+    };
+
+    // Write the screen to path at the end, or to numbered paths after every frame.
+    auto setScreenshot(std::string const &path) -> void
+    {
+        mScreenshotPath = path;
+    };
+
+    // Print the step count and screen hash at the end, or after every frame.
+    auto setScreenHashes(bool screenHashes) -> void
+    {
+        mScreenHashes = screenHashes;
+    };
+
+    // Run at most maxSteps, returns the number run. step runs the emulator for
+    // at most the given number of steps and returns the number run, fewer if
+    // it halted. clock counts the emulator's steps since the program started.
+    auto run(uint64_t maxSteps, std::vector<int16_t> &ram,
+             std::function<uint64_t(uint64_t)> const &step,
+             std::function<uint64_t()> const &clock) -> uint64_t;
+};
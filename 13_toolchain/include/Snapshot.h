@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Start of a snapshot file, followed by ramSize RAM words.
+//
+// Both are stored in host byte order, like a core dump, so a snapshot can be
+// mapped and copied into the emulator without decoding.
+struct SnapshotHeader
+{
+    char magic[4];    // "HSS1"
+    uint32_t ramSize; // Words of RAM after the header
+    uint64_t program; // Hash of the code the state belongs to
+    uint64_t cycles;  // Cycles, or steps of VM code
+    int32_t pc;
+    int16_t a; // Hack registers, 0 for VM code
+    int16_t d;
+    uint32_t halted;
+    uint32_t reserved;
+};
+
+static_assert(sizeof(SnapshotHeader) == 40, "snapshot header must not be padded");
+
+inline constexpr uint64_t HASH_SEED = 14695981039346656037ull;
+
+// FNV-1a, one value at a time, to identify the program of a snapshot.
+inline auto hashValue(uint64_t hash, int64_t value) -> uint64_t
+{
+    for (int i = 0; i < 8; i++)
+    {
+        hash ^= static_cast<uint64_t>(value >> (8 * i)) & 0xff;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+auto writeSnapshot(std::string const &path, SnapshotHeader header,
+                   std::vector<int16_t> const &ram) -> void;
+
+// Read a snapshot of the given program, RAM is copied straight out of the
+// mapped file. Throws if the file is malformed or belongs to other code.
+auto readSnapshot(std::string const &path, uint64_t program, std::vector<int16_t> &ram)
+    -> SnapshotHeader;
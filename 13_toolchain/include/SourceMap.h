@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct SourceLocation
+{
+    int file; // Index into the files of the map
+    int line; // 1-based, 0 if unknown
+};
+
+// Maps code addresses, ROM words or VM commands, to lines of their source.
+//
+// Stored as a sidecar file next to the code (Prog.hack.map, Class.vm.map):
+//
+//     "HSM1"
+//     varint nFiles, per file: varint length, name
+//     varint nRuns, per run: varint length, zigzag varint file delta,
+//                            zigzag varint line delta
+//
+// A run covers consecutive addresses with the same location, deltas are taken
+// to the previous run. All varints are LEB128. Compiled code moves forward
+// through its source, so most runs take three bytes.
+class SourceMap
+{
+private:
+    std::vector<std::string> mFiles;
+    std::vector<SourceLocation> mLocations;
+
+public:
+    SourceMap() : mFiles(), mLocations(){};
+
+    // Location of the next address.
+    auto add(std::string const &file, int line) -> void;
+
+    auto addFile(std::string const &file) -> int;
+
+    auto add(SourceLocation location) -> void
+    {
+        mLocations.push_back(location);
+    };
+
+    auto empty() const -> bool
+    {
+        return mLocations.empty();
+    };
+
+    auto size() const -> size_t
+    {
+        return mLocations.size();
+    };
+
+    auto at(size_t address) const -> SourceLocation
+    {
+        return address < mLocations.size() ? mLocations[address] : SourceLocation{0, 0};
+    };
+
+    auto files() const -> std::vector<std::string> const &
+    {
+        return mFiles;
+    };
+
+    auto write(std::string const &path) -> void;
+
+    // Read a map written by write, throws on malformed files.
+    auto read(std::string const &path) -> void;
+};
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "CPUEmulator.h"
+#include "VMInterpreter.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum class TestCommandType
+{
+    LOAD,
+    OUTPUT_FILE,
+    COMPARE_TO,
+    OUTPUT_LIST,
+    SET,
+    REPEAT,
+    TICKTOCK,
+    VMSTEP,
+    OUTPUT,
+    ECHO
+};
+
+// A column of an output-list, e.g. RAM[256]%D1.6.1.
+struct OutputColumn
+{
+    std::string name;
+    int left;
+    int width;
+    int right;
+};
+
+struct TestCommand
+{
+    TestCommandType type;
+    std::string argument;              // File name, set target or echo text
+    int value;                         // Value of a set
+    uint64_t count;                    // Repetitions of a repeat
+    std::vector<TestCommand> body;     // Commands of a repeat
+    std::vector<OutputColumn> columns; // Columns of an output-list
+    int line;
+};
+
+struct TestResult
+{
+    bool passed;
+    std::string message; // Reason of a failure
+    uint64_t steps;      // Executed ticktocks or vmsteps
+};
+
+// Runs a .tst script of the course's CPU and VM emulators natively.
+//
+// Supports the subset of the script language used by the tests of projects 07,
+// 08 and 12: load, output-file, compare-to, output-list (%D columns of RAM
+// words), set, repeat, ticktock, vmstep, output and echo. Loading an .asm file
+// drives the CPUEmulator, loading .vm files or a directory the VMInterpreter.
+// An .asm file that does not exist yet is translated from the .vm files next
+// to the script first, like VMTranslator would. Translated .asm files and the
+// output file go to the output directory, the script's directory is only
+// read. The output is compared to the .cmp file line by line, where * in the
+// .cmp file matches any character.
+class TestScript
+{
+private:
+    std::string mPath;
+    std::string mDirectory;
+    std::string mOutputDirectory;
+    std::vector<TestCommand> mCommands;
+    std::vector<std::string> mLibraries;
+    bool mTranslate;
+    std::unique_ptr<CPUEmulator> mCpu;
+    std::unique_ptr<VMInterpreter> mVm;
+    std::string mOutputFile;
+    std::string mCompareFile;
+    std::vector<OutputColumn> mColumns;
+    std::vector<std::string> mOutput;
+    uint64_t mSteps;
+
+    auto parse() -> void;
+
+    auto execute(std::vector<TestCommand> const &commands) -> void;
+
+    auto load(TestCommand const &command) -> void;
+
+    auto translate(std::string const &asmPath) -> void;
+
+    // RAM address of a set target or output column: RAM[i], sp, local,
+    // argument, this, that, or local[i], argument[i], this[i], that[i], temp[i].
+    auto address(std::string const &name, int line) -> int;
+
+    auto peek(int address) -> int16_t;
+
+    auto poke(int address, int16_t value) -> void;
+
+    auto step(TestCommandType type, uint64_t count, int line) -> void;
+
+    auto compare() -> std::string;
+
+public:
+    TestScript(std::string path);
+
+    // Add the .vm files of dir for classes a VM test does not define itself.
+    auto addLibrary(std::string const &dir) -> void
+    {
+        mLibraries.push_back(dir);
+    };
+
+    // Translated .asm files and the output file are written to
+    // <dir>/<absolute path of the script's directory>/<script>, by default
+    // with dir TestRunner in the system's temporary directory.
+    auto setOutputDirectory(std::string const &dir) -> void;
+
+    // Translate the .vm files of the script's directory even if the .asm file
+    // it loads exists.
+    auto setTranslate(bool translate) -> void
+    {
+        mTranslate = translate;
+    };
+
+    auto commands() -> std::vector<TestCommand> const &
+    {
+        return mCommands;
+    };
+
+    // Execute the script, write its output file and compare it. Errors in the
+    // script or the program are reported as a failed result.
+    auto run() -> TestResult;
+};
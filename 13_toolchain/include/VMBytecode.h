@@ -0,0 +1,21 @@
+#pragma once
+
+#include "definitions.h"
+#include <string>
+
+// Binary form of a .vm file (.vmb), loaded without tokenizing text.
+//
+// All numbers are little endian 32 bit words unless noted:
+//
+//     "VMB1", nCommands, nFunctions, nStringBytes
+//     nFunctions times: name, index of the function command, nLocals
+//     nCommands times, 8 bytes each:
+//         u8 type, u8 segment or arithmetic command, u16 nArgs or nLocals,
+//         u32 segment index or name
+//     nStringBytes of names, each terminated by a zero byte
+//
+// Names are byte offsets into the strings, every name is stored once. The
+// codes of types, segments and commands are listed in VMBytecode.cpp.
+auto readBytecode(std::string const &path) -> VMFile;
+
+auto writeBytecode(VMFile const &file, std::string const &path) -> void;
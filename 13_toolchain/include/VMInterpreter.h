@@ -0,0 +1,226 @@
+#pragma once
+
+#include "Profiler.h"
+#include "SourceMap.h"
+#include "VMProgram.h"
+#include "definitions.h"
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Bytecode operations. Segment accesses are resolved as far as possible at
+// load time: static, temp and pointer become fixed RAM addresses.
+enum class OpCode : uint8_t
+{
+    PUSH_CONST,
+    PUSH_LOCAL,
+    PUSH_ARG,
+    PUSH_THIS,
+    PUSH_THAT,
+    PUSH_FIXED,
+    POP_LOCAL,
+    POP_ARG,
+    POP_THIS,
+    POP_THAT,
+    POP_FIXED,
+    ADD,
+    SUB,
+    NEG,
+    EQ,
+    GT,
+    LT,
+    AND,
+    OR,
+    NOT,
+    GOTO,
+    IF_GOTO,
+    FUNCTION,
+    CALL,
+    RETURN,
+    NATIVE, // call of an OS function with a native version, see VMInterpreter::setNativeOS
+    // Superinstructions, see VMInterpreter::fuse
+    ADD_CONST,       // push constant c; add
+    SUB_CONST,       // push constant c; sub
+    ADD_LOCAL,       // push local i; add
+    ADD_ARG,         // push argument i; add
+    INC_LOCAL,       // push local i; push constant c; add; pop local i [; goto]
+    DEC_LOCAL,       // push local i; push constant c; sub; pop local i [; goto]
+    READ_THAT,       // add; pop pointer 1; push that 0
+    READ_THAT_LOCAL, // push local i; add; pop pointer 1; push that 0
+    PUSH_ELEMENT,    // push constant c; push local i; add; pop pointer 1; push that 0
+    STORE_THAT,      // pop temp t; pop pointer 1; push temp t; pop that 0
+    CMP_CONST,       // push constant c; eq|gt|lt [; not]
+    CMP_IF,          // eq|gt|lt [; not]; if-goto
+    CMP_CONST_IF,    // push constant c; eq|gt|lt [; not]; if-goto
+    CMP_LOCAL_IF,    // push local i; push constant c; eq|gt|lt [; not]; if-goto
+    NOT_IF,          // not; if-goto
+    POP_LOCAL_GOTO   // pop local i; goto
+};
+
+struct VMInstruction
+{
+    OpCode op;
+    uint8_t length; // Number of VM commands, more than one for superinstructions
+    int32_t arg;    // Constant, segment index, RAM address, nLocals or nArgs
+    int32_t arg2;   // Second operand of superinstructions
+    int32_t target; // Resolved bytecode index of a label or function
+    // Comparisons of superinstructions hold if x < y, x == y, x > y matches
+    // bit 2, 1, 0 like the jump bits of a Hack C-instruction.
+    uint8_t condition = 0;
+};
+
+// Executes VM code on the Hack RAM model.
+//
+// The stack and the segment pointers live in RAM like on the real platform,
+// so RAM dumps compare against the course's .cmp files. One step executes one
+// VM command, matching vmstep in .tst scripts; labels are not commands.
+//
+// Frequent command sequences of compiled Jack code are fused into
+// superinstructions at load time. They leave RAM exactly as the single
+// commands would, including the words popped off the stack, and are only used
+// while the whole sequence fits into the step budget.
+class VMInterpreter
+{
+private:
+    std::vector<VMInstruction> mCode;
+    std::vector<VMInstruction> mFused; // mCode with superinstructions at fused starts
+    bool mFusion;
+    bool mNativeOS;
+    std::vector<std::string> mFunctionNames;
+    std::vector<int> mFunctionOf; // Index into mFunctionNames per instruction, -1 before any
+    SourceMap mSources;           // .jack line per instruction
+    std::vector<std::pair<int, int>> mOrigins; // File and command index per instruction
+    std::unordered_map<std::string, int> mFunctions;
+    std::vector<int16_t> mRam;
+    int mPc;
+    uint64_t mSteps;
+    uint64_t mDispatches;
+    bool mHalted;
+    Profiler *mProfiler;
+
+    auto fuse(std::vector<bool> const &isTarget) -> void;
+
+    auto interpret(uint64_t maxSteps) -> uint64_t;
+
+    auto runProfiled(uint64_t maxSteps) -> uint64_t;
+
+    auto programHash() -> uint64_t;
+
+public:
+    VMInterpreter()
+        : mCode(), mFused(), mFusion(true), mNativeOS(false), mFunctionNames(),
+          mFunctionOf(), mSources(), mOrigins(), mFunctions(), mRam(RAM_SIZE, 0), mPc(0),
+          mSteps(0), mDispatches(0), mHalted(false), mProfiler(nullptr){};
+
+    // Use superinstructions, on by default. Takes effect on the next load.
+    auto setFusion(bool fusion) -> void
+    {
+        mFusion = fusion;
+    };
+
+    // Run calls of the OS functions in NativeOS as C++, off by default. Takes
+    // effect on the next load. A native call is one step; it pops the arguments
+    // and pushes the result like the VM function would, but leaves no frame
+    // behind on the stack. Where the native version leaves the result to the OS,
+    // the function's VM code runs, and the program halts if there is none.
+    auto setNativeOS(bool nativeOS) -> void
+    {
+        mNativeOS = nativeOS;
+    };
+
+    // Count every command in the profiler, superinstructions are not used then.
+    // The profiler is not owned, nullptr turns profiling off.
+    auto setProfiler(Profiler *profiler) -> void
+    {
+        mProfiler = profiler;
+    };
+
+    // Resolve the program into bytecode, throws on calls to unknown functions,
+    // except native ones.
+    auto load(VMProgram &program) -> void;
+
+    // Clear RAM and start over. With Sys.init the program starts there with
+    // SP = 256 and a bootstrap frame, otherwise at the first command.
+    auto reset() -> void;
+
+    // Run up to maxSteps VM commands, returns the number executed.
+    auto run(uint64_t maxSteps) -> uint64_t;
+
+    // Save RAM, program counter and step count, to resume runs of the same
+    // program from there with restoreSnapshot.
+    auto saveSnapshot(std::string const &path) -> void;
+
+    auto restoreSnapshot(std::string const &path) -> void;
+
+    auto peek(int address) -> int16_t
+    {
+        return mRam[address & (RAM_SIZE - 1)];
+    };
+
+    auto poke(int address, int16_t value) -> void
+    {
+        mRam[address & (RAM_SIZE - 1)] = value;
+    };
+
+    auto dumpRam(std::vector<int> const &addresses, std::ostream &out) -> void;
+
+    auto ram() -> std::vector<int16_t> &
+    {
+        return mRam;
+    };
+
+    auto code() -> std::vector<VMInstruction> const &
+    {
+        return mCode;
+    };
+
+    auto functionNames() -> std::vector<std::string> const &
+    {
+        return mFunctionNames;
+    };
+
+    // Index into functionNames per instruction, -1 before the first function.
+    auto functionOf() -> std::vector<int> const &
+    {
+        return mFunctionOf;
+    };
+
+    // Jack source line per instruction, where the .vm files came with source maps.
+    auto sources() -> SourceMap const &
+    {
+        return mSources;
+    };
+
+    // Index into the files of the loaded program and into the commands of that
+    // file per instruction.
+    auto origins() -> std::vector<std::pair<int, int>> const &
+    {
+        return mOrigins;
+    };
+
+    // Name of the function executing, empty outside of functions.
+    auto currentFunction() -> std::string;
+
+    auto pc() -> int
+    {
+        return mPc;
+    };
+
+    auto steps() -> uint64_t
+    {
+        return mSteps;
+    };
+
+    // Number of executed instructions, lower than steps with superinstructions.
+    auto dispatches() -> uint64_t
+    {
+        return mDispatches;
+    };
+
+    auto halted() -> bool
+    {
+        return mHalted;
+    };
+};
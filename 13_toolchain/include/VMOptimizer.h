@@ -0,0 +1,54 @@
+#pragma once
+
+#include "BlockCounts.h"
+#include "VMProgram.h"
+#include "definitions.h"
+#include <map>
+#include <set>
+#include <string>
+
+// Whole program passes over the VM commands of a program.
+class VMOptimizer
+{
+private:
+    VMProgram &mProgram;
+
+    auto callGraph() -> std::map<std::string, std::set<std::string>>;
+
+    // Lay out the function of commands [begin, end) into out, unless that would
+    // not execute fewer commands.
+    auto layoutFunction(std::vector<VMCommand> const &commands, size_t begin, size_t end,
+                        ClassCounts const &counts, std::vector<VMCommand> &out) -> bool;
+
+    // Share the local slots of the function of commands [begin, end), returns
+    // the number of slots saved.
+    auto shareFunctionLocals(std::vector<VMCommand> &commands, size_t begin, size_t end)
+        -> int;
+
+public:
+    VMOptimizer(VMProgram &program) : mProgram(program){};
+
+    // Drop all functions not reachable through calls from Sys.init, or from the
+    // first function for programs without Sys, or by running into them from the
+    // function before, also across files. Returns the number of removed functions.
+    auto eliminateDeadFunctions() -> int;
+
+    // Reorder the basic blocks of every profiled function so that the most
+    // executed jumps and branches fall through, e.g. rotate hot while loops to
+    // test their condition at the end. Branches on comparisons are inverted by
+    // adding or dropping a not. Returns the number of changed functions.
+    auto layoutBlocks(BlockCounts const &counts) -> int;
+
+    // Let locals whose values are never needed at the same time share a slot,
+    // which shrinks nLocals, the zeroing on entry and the stack frame. Every
+    // slot is zero on entry, so locals read before their first write still
+    // see 0. Returns the number of saved slots.
+    auto shareLocals() -> int;
+
+    // Keep one copy of functions with the same body, e.g. getters of several
+    // classes, and call it in place of the others. Labels are compared by
+    // position, statics only within a file. Functions that run into the next
+    // one, and the ones they run into, are kept. Returns the number of removed
+    // functions.
+    auto foldIdenticalFunctions() -> int;
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "definitions.h"
+#include <fstream>
+#include <string>
+
+class VMParser
+{
+private:
+    std::ifstream mFile;
+    std::string mPath;
+    int mLineNumber;
+
+    auto parseLine(std::string const &line) -> VMCommand;
+
+public:
+    VMParser(std::string path) : mFile(path), mPath(path), mLineNumber(0){};
+
+    ~VMParser()
+    {
+        if (mFile.is_open())
+            mFile.close();
+    };
+
+    // Read the whole file into a list of commands.
+    auto parse() -> VMFile;
+};
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "definitions.h"
+#include <string>
+#include <vector>
+
+class VMProgram
+{
+private:
+    std::vector<VMFile> mFiles;
+
+public:
+    VMProgram(){};
+
+    // Load a single .vm or .vmb file or all of a directory. A class with both
+    // is loaded from the .vmb file unless the .vm file is newer.
+    auto load(std::string const &pathOrDir) -> void;
+
+    // Add the .vm files of dir for classes the program does not define itself,
+    // e.g. the OS. Returns the number of added files.
+    auto loadLibrary(std::string const &dir) -> int;
+
+    auto addFile(VMFile file) -> void;
+
+    // Write every file back as .vm text, or .vmb bytecode, into the given
+    // directory.
+    auto save(std::string const &dir, bool bytecode = false) -> void;
+
+    auto files() -> std::vector<VMFile> &
+    {
+        return mFiles;
+    };
+
+    auto hasFunction(std::string const &name) -> bool;
+
+    auto commandCount() -> int;
+
+    auto functionCount() -> int;
+};
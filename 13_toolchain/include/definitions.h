@@ -0,0 +1,112 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+enum class CommandType
+{
+    ARITHMETIC,
+    PUSH,
+    POP,
+    LABEL,
+    GOTO,
+    IF,
+    FUNCTION,
+    RETURN,
+    CALL
+};
+
+enum class Segment
+{
+    CONST,
+    ARG,
+    LOCAL,
+    STATIC,
+    THIS,
+    THAT,
+    POINTER,
+    TEMP,
+    NONE
+};
+
+enum class Command
+{
+    ADD,
+    SUB,
+    NEG,
+    EQ,
+    GT,
+    LT,
+    AND,
+    OR,
+    NOT,
+    NONE
+};
+
+inline std::map<std::string, Segment> stringToSegment{
+    {std::string{"constant"}, Segment::CONST},  {std::string{"argument"}, Segment::ARG},
+    {std::string{"local"}, Segment::LOCAL},     {std::string{"static"}, Segment::STATIC},
+    {std::string{"this"}, Segment::THIS},       {std::string{"that"}, Segment::THAT},
+    {std::string{"pointer"}, Segment::POINTER}, {std::string{"temp"}, Segment::TEMP},
+};
+
+inline std::map<Segment, std::string> segmentToString{
+    {Segment::CONST, std::string{"constant"}},  {Segment::ARG, std::string{"argument"}},
+    {Segment::LOCAL, std::string{"local"}},     {Segment::STATIC, std::string{"static"}},
+    {Segment::THIS, std::string{"this"}},       {Segment::THAT, std::string{"that"}},
+    {Segment::POINTER, std::string{"pointer"}}, {Segment::TEMP, std::string{"temp"}},
+};
+
+// Segments addressed through a base pointer held in RAM.
+inline std::map<Segment, std::string> segmentToBase{
+    {Segment::LOCAL, std::string{"LCL"}},
+    {Segment::ARG, std::string{"ARG"}},
+    {Segment::THIS, std::string{"THIS"}},
+    {Segment::THAT, std::string{"THAT"}},
+};
+
+inline std::map<std::string, Command> stringToCommand{
+    {std::string{"add"}, Command::ADD}, {std::string{"sub"}, Command::SUB},
+    {std::string{"neg"}, Command::NEG}, {std::string{"eq"}, Command::EQ},
+    {std::string{"gt"}, Command::GT},   {std::string{"lt"}, Command::LT},
+    {std::string{"and"}, Command::AND}, {std::string{"or"}, Command::OR},
+    {std::string{"not"}, Command::NOT},
+};
+
+inline std::map<Command, std::string> commandToString{
+    {Command::ADD, std::string{"add"}}, {Command::SUB, std::string{"sub"}},
+    {Command::NEG, std::string{"neg"}}, {Command::EQ, std::string{"eq"}},
+    {Command::GT, std::string{"gt"}},   {Command::LT, std::string{"lt"}},
+    {Command::AND, std::string{"and"}}, {Command::OR, std::string{"or"}},
+    {Command::NOT, std::string{"not"}},
+};
+
+struct VMCommand
+{
+    CommandType type;
+    Command command;   // Only for ARITHMETIC
+    Segment segment;   // Only for PUSH and POP
+    std::string name;  // Label, function or callee name
+    int index;         // Segment index, nLocals or nArgs
+    int line;          // Line in the .vm source file
+    int sourceLine;    // Line in the .jack source from the source map, 0 if unknown
+};
+
+struct VMFile
+{
+    std::string name; // Class name, used to scope statics
+    std::string path;
+    std::string source; // The .jack file, if a source map came with the .vm file
+    std::vector<VMCommand> commands;
+};
+
+// Hack platform constants.
+inline constexpr int ROM_SIZE = 32768;
+inline constexpr int RAM_SIZE = 32768;
+inline constexpr int STACK_BASE = 256;
+inline constexpr int SCREEN_BASE = 16384;
+inline constexpr int SCREEN_WIDTH = 512;
+inline constexpr int SCREEN_HEIGHT = 256;
+inline constexpr int SCREEN_WORDS = SCREEN_WIDTH * SCREEN_HEIGHT / 16;
+inline constexpr int KBD_ADDRESS = 24576;
@@ -0,0 +1,323 @@
+#include "AsmOptimizer.h"
+#include "definitions.h"
+#include <algorithm>
+#include <map>
+#include <set>
+#include <unordered_map>
+
+struct CInstruction
+{
+    std::string dest;
+    std::string comp;
+    std::string jump;
+};
+
+// Sequences and shorter ones that leave A, D and RAM the same, as long as SP
+// does not point at itself.
+inline const std::vector<std::pair<std::vector<std::string>, std::vector<std::string>>>
+    rewrites{
+        // Push D and pop it again: D stays and the slot above the stack is written.
+        {{"@SP", "AM=M+1", "A=A-1", "M=D", "@SP", "AM=M-1", "D=M"}, {"@SP", "A=M", "M=D"}},
+        // Pop into D and push it again.
+        {{"@SP", "AM=M-1", "D=M", "@SP", "AM=M+1", "A=A-1", "M=D"}, {"@SP", "A=M-1", "D=M"}},
+    };
+
+inline auto is_label(std::string const &line) -> bool
+{
+    return line.front() == '(';
+}
+
+inline auto is_load(std::string const &line) -> bool
+{
+    return line.front() == '@';
+}
+
+inline auto split_instruction(std::string const &line) -> CInstruction
+{
+    CInstruction instruction;
+    auto comp = line;
+    auto eq = comp.find('=');
+    if (eq != std::string::npos)
+    {
+        instruction.dest = comp.substr(0, eq);
+        comp = comp.substr(eq + 1);
+    }
+    auto semicolon = comp.find(';');
+    if (semicolon != std::string::npos)
+    {
+        instruction.jump = comp.substr(semicolon + 1);
+        comp = comp.substr(0, semicolon);
+    }
+    instruction.comp = comp;
+    return instruction;
+}
+
+// A jump that neither reads nor writes A or RAM, so it only depends on where it
+// lands, e.g. 0;JMP or D;JGT.
+inline auto is_plain_jump(std::string const &line) -> bool
+{
+    if (is_label(line) || is_load(line))
+        return false;
+    auto instruction = split_instruction(line);
+    return !instruction.jump.empty() && instruction.dest.empty() &&
+           (instruction.comp == "0" || instruction.comp == "D");
+}
+
+inline auto is_goto(std::string const &line) -> bool
+{
+    return line == "0;JMP";
+}
+
+auto AsmOptimizer::labelCodeAddresses() -> void
+{
+    // Addresses of the instructions, and the labels already there.
+    std::vector<size_t> indexOf;
+    std::map<int, std::string> labelAt;
+    std::set<std::string> symbols;
+    for (size_t i = 0; i < mLines.size(); i++)
+    {
+        auto &line = mLines[i].first;
+        if (is_label(line))
+        {
+            auto label = line.substr(1, line.size() - 2);
+            labelAt.emplace(static_cast<int>(indexOf.size()), label);
+            symbols.insert(label);
+        }
+        else
+        {
+            if (is_load(line))
+                symbols.insert(line.substr(1));
+            indexOf.push_back(i);
+        }
+    }
+    indexOf.push_back(mLines.size());
+
+    std::map<size_t, std::string> added; // Line index to insert the label in front of
+    for (size_t i = 0; i + 1 < mLines.size(); i++)
+    {
+        auto &line = mLines[i].first;
+        auto &next = mLines[i + 1].first;
+        if (!is_load(line) || line.size() < 2 || line.size() > 6 ||
+            line.find_first_not_of("0123456789", 1) != std::string::npos ||
+            is_label(next) || is_load(next) || split_instruction(next).jump.empty())
+            continue;
+        auto address = std::stoi(line.substr(1));
+        if (static_cast<size_t>(address) >= indexOf.size())
+            continue;
+        auto found = labelAt.find(address);
+        if (found == labelAt.end())
+        {
+            auto label = "ROM$" + std::to_string(address);
+            while (symbols.count(label) > 0)
+                label += "$";
+            symbols.insert(label);
+            found = labelAt.emplace(address, label).first;
+            added[indexOf[address]] = label;
+        }
+        line = "@" + found->second;
+    }
+
+    std::vector<std::pair<std::string, int>> lines;
+    for (size_t i = 0; i <= mLines.size(); i++)
+    {
+        auto label = added.find(i);
+        if (label != added.end())
+            lines.push_back({"(" + label->second + ")",
+                             i < mLines.size() ? mLines[i].second : mLines.back().second});
+        if (i < mLines.size())
+            lines.push_back(std::move(mLines[i]));
+    }
+    mLines = std::move(lines);
+}
+
+auto AsmOptimizer::removeRedundantLoads() -> int
+{
+    std::string a = "";  // Symbol A was loaded with, empty if unknown
+    bool dIsM = false;   // D equals RAM[A]
+    int removed = 0;
+    std::vector<std::pair<std::string, int>> lines;
+    for (auto &entry : mLines)
+    {
+        auto &line = entry.first;
+        if (is_label(line))
+        {
+            a = "";
+            dIsM = false;
+        }
+        else if (is_load(line))
+        {
+            if (line.substr(1) == a)
+            {
+                removed++;
+                continue;
+            }
+            a = line.substr(1);
+            dIsM = false;
+        }
+        else
+        {
+            // The keyboard may change between two reads.
+            bool known = !a.empty() && a != "KBD" && a != std::to_string(KBD_ADDRESS);
+            if ((line == "D=M" || line == "M=D") && dIsM && known)
+            {
+                removed++;
+                continue;
+            }
+            auto instruction = split_instruction(line);
+            if (instruction.dest.find('A') != std::string::npos)
+            {
+                a = "";
+                dIsM = false;
+            }
+            else if (!instruction.dest.empty())
+            {
+                bool d = instruction.dest.find('D') != std::string::npos;
+                bool m = instruction.dest.find('M') != std::string::npos;
+                dIsM = (d && m) || (d && instruction.comp == "M") ||
+                       (m && instruction.comp == "D");
+            }
+        }
+        lines.push_back(std::move(entry));
+    }
+    mLines = std::move(lines);
+    return removed;
+}
+
+auto AsmOptimizer::rewriteSequences() -> int
+{
+    int removed = 0;
+    std::vector<std::pair<std::string, int>> lines;
+    for (size_t i = 0; i < mLines.size();)
+    {
+        auto rewrite = std::find_if(rewrites.begin(), rewrites.end(), [&](auto const &rule) {
+            auto &pattern = rule.first;
+            if (i + pattern.size() > mLines.size())
+                return false;
+            for (size_t j = 0; j < pattern.size(); j++)
+                if (mLines[i + j].first != pattern[j])
+                    return false;
+            return true;
+        });
+        if (rewrite == rewrites.end())
+        {
+            lines.push_back(std::move(mLines[i++]));
+            continue;
+        }
+        for (auto &instruction : rewrite->second)
+            lines.push_back({instruction, mLines[i].second});
+        removed += static_cast<int>(rewrite->first.size() - rewrite->second.size());
+        i += rewrite->first.size();
+    }
+    mLines = std::move(lines);
+    return removed;
+}
+
+auto AsmOptimizer::threadJumps() -> int
+{
+    // First instruction after every label.
+    std::unordered_map<std::string, size_t> target;
+    std::vector<std::string> pending;
+    for (size_t i = 0; i < mLines.size(); i++)
+    {
+        auto &line = mLines[i].first;
+        if (is_label(line))
+        {
+            pending.push_back(line.substr(1, line.size() - 2));
+            continue;
+        }
+        for (auto &label : pending)
+            target[label] = i;
+        pending.clear();
+    }
+
+    // The label a jump to label ends up at through @L 0;JMP chains.
+    auto destination = [&](std::string label) {
+        std::set<std::string> seen{label};
+        while (true)
+        {
+            auto found = target.find(label);
+            if (found == target.end() || found->second + 1 >= mLines.size())
+                return label;
+            auto &load = mLines[found->second].first;
+            if (!is_load(load) || !is_goto(mLines[found->second + 1].first) ||
+                !target.count(load.substr(1)) || !seen.insert(load.substr(1)).second)
+                return label;
+            label = load.substr(1);
+        }
+    };
+
+    int threaded = 0;
+    for (size_t i = 0; i + 1 < mLines.size(); i++)
+    {
+        auto &line = mLines[i].first;
+        if (!is_load(line) || !is_plain_jump(mLines[i + 1].first))
+            continue;
+        // Code after a conditional jump may still use A.
+        if (split_instruction(mLines[i + 1].first).jump != "JMP" &&
+            (i + 2 >= mLines.size() || !is_load(mLines[i + 2].first)))
+            continue;
+        auto label = destination(line.substr(1));
+        if (label != line.substr(1))
+        {
+            line = "@" + label;
+            threaded++;
+        }
+    }
+    return threaded;
+}
+
+auto AsmOptimizer::removeDeadCode() -> int
+{
+    int removed = 0;
+    std::vector<std::pair<std::string, int>> lines;
+    bool reachable = true;
+    for (size_t i = 0; i < mLines.size(); i++)
+    {
+        auto &line = mLines[i].first;
+        if (is_label(line))
+            reachable = true;
+        else if (!reachable)
+        {
+            removed++;
+            continue;
+        }
+
+        // @L and a jump right in front of (L) only set A, which is loaded
+        // again after the label.
+        if (is_load(line) && i + 1 < mLines.size() && is_plain_jump(mLines[i + 1].first))
+        {
+            auto target = std::string{"("}.append(line, 1).append(")");
+            size_t next = i + 2;
+            bool lands = false;
+            while (next < mLines.size() && is_label(mLines[next].first))
+                lands |= mLines[next++].first == target;
+            if (lands && next < mLines.size() && is_load(mLines[next].first))
+            {
+                removed += 2;
+                i++;
+                continue;
+            }
+        }
+
+        if (!is_label(line) && !is_load(line) && split_instruction(line).jump == "JMP")
+            reachable = false;
+        lines.push_back(std::move(mLines[i]));
+    }
+    mLines = std::move(lines);
+    return removed;
+}
+
+auto AsmOptimizer::optimize() -> int
+{
+    this->labelCodeAddresses();
+    int removed = 0;
+    while (true)
+    {
+        auto changed = this->threadJumps();
+        auto dropped = this->removeDeadCode() + this->rewriteSequences() +
+                       this->removeRedundantLoads();
+        removed += dropped;
+        if (changed + dropped == 0)
+            return removed;
+    }
+}
@@ -0,0 +1,71 @@
+#include "BlockCounts.h"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+auto BlockCounts::add(std::string const &className, int nCommands, int index,
+                      CommandCount count) -> void
+{
+    auto &counts = mClasses[className];
+    counts.nCommands = nCommands;
+    counts.commands[index] = count;
+}
+
+auto BlockCounts::contains(std::string const &className) const -> bool
+{
+    return mClasses.count(className) != 0;
+}
+
+auto BlockCounts::find(std::string const &className, int nCommands) const
+    -> ClassCounts const *
+{
+    auto found = mClasses.find(className);
+    if (found == mClasses.end() || found->second.nCommands != nCommands)
+        return nullptr;
+    return &found->second;
+}
+
+auto BlockCounts::read(std::string const &path) -> void
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+        throw std::runtime_error("Could not open " + path);
+    ClassCounts *counts = nullptr;
+    std::string text;
+    for (int line = 1; std::getline(file, text); line++)
+    {
+        std::istringstream stream(text);
+        std::string word;
+        if (!(stream >> word))
+            continue;
+        if (word == "class")
+        {
+            std::string name;
+            int nCommands = 0;
+            if (!(stream >> name >> nCommands))
+                throw std::runtime_error(path + ":" + std::to_string(line) +
+                                         ": expected class name and command count");
+            counts = &mClasses[name];
+            counts->nCommands = nCommands;
+            continue;
+        }
+        CommandCount count{0, 0};
+        if (counts == nullptr || !(stream >> count.count >> count.taken))
+            throw std::runtime_error(path + ":" + std::to_string(line) +
+                                     ": expected index, count and taken");
+        counts->commands[std::stoi(word)] = count;
+    }
+}
+
+auto BlockCounts::write(std::string const &path) -> void
+{
+    std::ofstream file(path);
+    if (!file.is_open())
+        throw std::runtime_error("Could not open " + path);
+    for (auto &[name, counts] : mClasses)
+    {
+        file << "class " << name << " " << counts.nCommands << "\n";
+        for (auto &[index, count] : counts.commands)
+            file << index << " " << count.count << " " << count.taken << "\n";
+    }
+}
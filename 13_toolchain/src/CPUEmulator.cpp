@@ -0,0 +1,387 @@
+#include "CPUEmulator.h"
+#include "CmpFormat.h"
+#include "Snapshot.h"
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <stdexcept>
+
+auto CPUEmulator::load(std::string const &path) -> void
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("Could not open " + path);
+    std::string content{std::istreambuf_iterator<char>(file),
+                        std::istreambuf_iterator<char>()};
+
+    std::vector<uint16_t> rom;
+    bool isText = content.find_first_not_of("01 \t\r\n") == std::string::npos;
+    if (isText)
+    {
+        size_t pos = 0;
+        int line = 1;
+        while (pos < content.size())
+        {
+            auto end = content.find('\n', pos);
+            if (end == std::string::npos)
+                end = content.size();
+            auto word = content.substr(pos, end - pos);
+            word.erase(word.find_last_not_of(" \t\r") + 1);
+            word.erase(0, word.find_first_not_of(" \t"));
+            if (!word.empty())
+            {
+                if (word.size() != 16)
+                    throw std::runtime_error(path + ":" + std::to_string(line) +
+                                             ": expected a 16 bit word, got " + word);
+                rom.push_back(static_cast<uint16_t>(std::stoul(word, nullptr, 2)));
+            }
+            pos = end + 1;
+            line++;
+        }
+    }
+    else
+    {
+        if (content.size() % 2 != 0)
+            throw std::runtime_error(path + ": binary image has an odd number of bytes");
+        for (size_t i = 0; i < content.size(); i += 2)
+            rom.push_back(static_cast<uint16_t>(
+                (static_cast<uint8_t>(content[i]) << 8) | static_cast<uint8_t>(content[i + 1])));
+    }
+    this->setRom(std::move(rom));
+}
+
+auto CPUEmulator::setRom(std::vector<uint16_t> rom) -> void
+{
+    if (rom.size() > ROM_SIZE)
+        throw std::runtime_error("Program of " + std::to_string(rom.size()) +
+                                 " words does not fit into the ROM");
+    mRom = std::move(rom);
+    this->decode();
+    if (mJit)
+        mJit->setRom(mRom);
+    this->reset();
+}
+
+auto CPUEmulator::reset() -> void
+{
+    mA = 0;
+    mD = 0;
+    mPc = 0;
+    mCycles = 0;
+    mHalted = false;
+}
+
+auto CPUEmulator::clearRam() -> void
+{
+    std::fill(mRam.begin(), mRam.end(), 0);
+}
+
+auto CPUEmulator::programHash() -> uint64_t
+{
+    uint64_t hash = hashValue(HASH_SEED, static_cast<int64_t>(mRom.size()));
+    for (auto word : mRom)
+        hash = hashValue(hash, word);
+    return hash;
+}
+
+auto CPUEmulator::saveSnapshot(std::string const &path) -> void
+{
+    SnapshotHeader header{};
+    header.program = this->programHash();
+    header.cycles = mCycles;
+    header.pc = mPc;
+    header.a = mA;
+    header.d = mD;
+    header.halted = mHalted;
+    writeSnapshot(path, header, mRam);
+}
+
+auto CPUEmulator::restoreSnapshot(std::string const &path) -> void
+{
+    auto header = readSnapshot(path, this->programHash(), mRam);
+    mCycles = header.cycles;
+    mPc = static_cast<uint16_t>(header.pc);
+    mA = header.a;
+    mD = header.d;
+    mHalted = header.halted != 0;
+}
+
+auto CPUEmulator::setJit(bool enabled) -> bool
+{
+    mJit.reset();
+    if (!enabled)
+        return true;
+    mJit = std::make_unique<HackJIT>();
+    if (!mJit->available())
+    {
+        mJit.reset();
+        return false;
+    }
+    mJit->setRom(mRom);
+    return true;
+}
+
+auto CPUEmulator::run(uint64_t maxCycles) -> uint64_t
+{
+    if (mProfiler)
+        return this->runProfiled(maxCycles);
+    if (mJit)
+        return this->runJit(maxCycles);
+    return this->interpret(maxCycles);
+}
+
+auto CPUEmulator::runProfiled(uint64_t maxCycles) -> uint64_t
+{
+    // One instruction at a time, so calls and returns are seen as they happen.
+    uint64_t executed = 0;
+    while (executed < maxCycles)
+    {
+        auto pc = mPc;
+        if (this->interpret(1) == 0)
+            break;
+        executed++;
+        mProfiler->count(pc);
+        if (mPc != pc + 1)
+            mProfiler->jump(mPc);
+    }
+    return executed;
+}
+
+auto CPUEmulator::runJit(uint64_t maxCycles) -> uint64_t
+{
+    uint64_t executed = 0;
+    while (executed < maxCycles && mPc < mRom.size() && !mHalted)
+    {
+        uint64_t remaining = maxCycles - executed;
+        // Blocks that do not fit into the remaining cycles and instructions the
+        // translator does not handle are interpreted one by one.
+        if (!mJit->compile(mPc) || static_cast<uint64_t>(mJit->blockLength(mPc)) > remaining)
+        {
+            executed += this->interpret(1);
+            continue;
+        }
+        auto budget = static_cast<int64_t>(
+            std::min<uint64_t>(remaining, std::numeric_limits<int64_t>::max()));
+        HackJIT::State state{mA, mD, budget, mRam.data(), nullptr, mPc};
+        mHalted = mJit->execute(state);
+        mA = static_cast<int16_t>(state.a);
+        mD = static_cast<int16_t>(state.d);
+        mPc = static_cast<uint16_t>(state.pc);
+        mCycles += budget - state.remaining;
+        executed += budget - state.remaining;
+    }
+    return executed;
+}
+
+auto CPUEmulator::decode() -> void
+{
+    // Handlers of the canonical comp codes, indexed by the c bits, for y = A and y = M.
+    static const std::map<int, std::pair<MicroOpHandler, MicroOpHandler>> compHandlers{
+        {0b101010, {MicroOpHandler::ZERO, MicroOpHandler::ZERO}},
+        {0b111111, {MicroOpHandler::ONE, MicroOpHandler::ONE}},
+        {0b111010, {MicroOpHandler::MINUS_ONE, MicroOpHandler::MINUS_ONE}},
+        {0b001100, {MicroOpHandler::D, MicroOpHandler::D}},
+        {0b110000, {MicroOpHandler::A, MicroOpHandler::M}},
+        {0b001101, {MicroOpHandler::NOT_D, MicroOpHandler::NOT_D}},
+        {0b110001, {MicroOpHandler::NOT_A, MicroOpHandler::NOT_M}},
+        {0b001111, {MicroOpHandler::NEG_D, MicroOpHandler::NEG_D}},
+        {0b110011, {MicroOpHandler::NEG_A, MicroOpHandler::NEG_M}},
+        {0b011111, {MicroOpHandler::D_PLUS_1, MicroOpHandler::D_PLUS_1}},
+        {0b110111, {MicroOpHandler::A_PLUS_1, MicroOpHandler::M_PLUS_1}},
+        {0b001110, {MicroOpHandler::D_MINUS_1, MicroOpHandler::D_MINUS_1}},
+        {0b110010, {MicroOpHandler::A_MINUS_1, MicroOpHandler::M_MINUS_1}},
+        {0b000010, {MicroOpHandler::D_PLUS_A, MicroOpHandler::D_PLUS_M}},
+        {0b010011, {MicroOpHandler::D_MINUS_A, MicroOpHandler::D_MINUS_M}},
+        {0b000111, {MicroOpHandler::A_MINUS_D, MicroOpHandler::M_MINUS_D}},
+        {0b000000, {MicroOpHandler::D_AND_A, MicroOpHandler::D_AND_M}},
+        {0b010101, {MicroOpHandler::D_OR_A, MicroOpHandler::D_OR_M}},
+    };
+
+    // Every 16 bit pc gets an entry, jumps out of the ROM land on STOP.
+    mDecoded.assign(65536, MicroOp{MicroOpHandler::STOP, 0, 0, false, 0});
+    for (size_t pc = 0; pc < mRom.size(); pc++)
+    {
+        uint16_t instruction = mRom[pc];
+        auto &op = mDecoded[pc];
+        if (!(instruction & 0x8000))
+        {
+            op = MicroOp{MicroOpHandler::LOAD, 0, 0, false, static_cast<int16_t>(instruction)};
+            continue;
+        }
+        auto handler = compHandlers.find((instruction >> 6) & 0x3f);
+        if (handler == compHandlers.end())
+            op.handler = MicroOpHandler::GENERIC;
+        else
+            op.handler = (instruction & 0x1000) ? handler->second.second
+                                                : handler->second.first;
+        op.dest = static_cast<uint8_t>((instruction >> 3) & 0x07);
+        op.jump = static_cast<uint8_t>(instruction & 0x07);
+        // The halt idiom, taken once the jump goes back to pc - 1.
+        op.mayHalt = pc > 0 && op.dest == 0 && mRom[pc - 1] == pc - 1;
+        op.value = static_cast<int16_t>(instruction);
+    }
+}
+
+// Computed goto dispatch where the compiler supports it, a switch otherwise.
+#if defined(__GNUC__) || defined(__clang__)
+#define HACK_COMPUTED_GOTO 1
+#endif
+
+auto CPUEmulator::interpret(uint64_t maxCycles) -> uint64_t
+{
+    if (mHalted)
+        return 0;
+
+    // Work on locals so the compiler can keep the registers in host registers.
+    int16_t a = mA;
+    int16_t d = mD;
+    uint16_t pc = mPc;
+    int16_t *ram = mRam.data();
+    const MicroOp *ops = mDecoded.data();
+    uint64_t cycle = 0;
+    MicroOp op;
+    int16_t out;
+
+#define MEM ram[static_cast<uint16_t>(a) & (RAM_SIZE - 1)]
+    // dest is the A, D, M bits, jump the lt, eq, gt bits of the instruction.
+    // Jumps go to the address A held before the instruction.
+#define WRITEBACK()                                                                      \
+    {                                                                                    \
+        uint16_t target = static_cast<uint16_t>(a);                                      \
+        if (op.dest & 0x01)                                                              \
+            ram[target & (RAM_SIZE - 1)] = out;                                          \
+        if (op.dest & 0x04)                                                              \
+            a = out;                                                                     \
+        if (op.dest & 0x02)                                                              \
+            d = out;                                                                     \
+        if (op.jump & (out < 0 ? 4 : (out == 0 ? 2 : 1)))                                \
+        {                                                                                \
+            if (op.mayHalt && target == pc - 1)                                          \
+            {                                                                            \
+                mHalted = true;                                                          \
+                pc = target;                                                             \
+                goto done;                                                               \
+            }                                                                            \
+            pc = target;                                                                 \
+        }                                                                                \
+        else                                                                             \
+            pc++;                                                                        \
+    }
+#define COMP(handler, expression)                                                        \
+    CASE(handler)                                                                        \
+    out = static_cast<int16_t>(expression);                                              \
+    WRITEBACK();                                                                         \
+    NEXT();
+
+#ifdef HACK_COMPUTED_GOTO
+    // Same order as MicroOpHandler.
+    static void *const handlers[] = {
+        &&LOAD,      &&ZERO,      &&ONE,       &&MINUS_ONE, &&D,         &&A,
+        &&M,         &&NOT_D,     &&NOT_A,     &&NOT_M,     &&NEG_D,     &&NEG_A,
+        &&NEG_M,     &&D_PLUS_1,  &&A_PLUS_1,  &&M_PLUS_1,  &&D_MINUS_1, &&A_MINUS_1,
+        &&M_MINUS_1, &&D_PLUS_A,  &&D_PLUS_M,  &&D_MINUS_A, &&D_MINUS_M, &&A_MINUS_D,
+        &&M_MINUS_D, &&D_AND_A,   &&D_AND_M,   &&D_OR_A,    &&D_OR_M,    &&GENERIC,
+        &&STOP};
+#define CASE(handler) handler:
+#define NEXT()                                                                           \
+    if (cycle == maxCycles)                                                              \
+        goto done;                                                                       \
+    op = ops[pc];                                                                        \
+    cycle++;                                                                             \
+    goto *handlers[static_cast<int>(op.handler)];
+
+    NEXT();
+#else
+#define CASE(handler) case MicroOpHandler::handler:
+#define NEXT() continue;
+
+    for (;;)
+    {
+        if (cycle == maxCycles)
+            goto done;
+        op = ops[pc];
+        cycle++;
+        switch (op.handler)
+        {
+#endif
+    CASE(LOAD)
+    a = op.value;
+    pc++;
+    NEXT();
+    COMP(ZERO, 0)
+    COMP(ONE, 1)
+    COMP(MINUS_ONE, -1)
+    COMP(D, d)
+    COMP(A, a)
+    COMP(M, MEM)
+    COMP(NOT_D, ~d)
+    COMP(NOT_A, ~a)
+    COMP(NOT_M, ~MEM)
+    COMP(NEG_D, -d)
+    COMP(NEG_A, -a)
+    COMP(NEG_M, -MEM)
+    COMP(D_PLUS_1, d + 1)
+    COMP(A_PLUS_1, a + 1)
+    COMP(M_PLUS_1, MEM + 1)
+    COMP(D_MINUS_1, d - 1)
+    COMP(A_MINUS_1, a - 1)
+    COMP(M_MINUS_1, MEM - 1)
+    COMP(D_PLUS_A, d + a)
+    COMP(D_PLUS_M, d + MEM)
+    COMP(D_MINUS_A, d - a)
+    COMP(D_MINUS_M, d - MEM)
+    COMP(A_MINUS_D, a - d)
+    COMP(M_MINUS_D, MEM - d)
+    COMP(D_AND_A, d & a)
+    COMP(D_AND_M, d & MEM)
+    COMP(D_OR_A, d | a)
+    COMP(D_OR_M, d | MEM)
+    CASE(GENERIC)
+    {
+        // Not in the comp table, compute what the ALU would do.
+        int c = (op.value >> 6) & 0x3f;
+        int16_t x = d;
+        int16_t y = (op.value & 0x1000) ? MEM : a;
+        if (c & 0x20)
+            x = 0;
+        if (c & 0x10)
+            x = ~x;
+        if (c & 0x08)
+            y = 0;
+        if (c & 0x04)
+            y = ~y;
+        out = (c & 0x02) ? static_cast<int16_t>(x + y) : static_cast<int16_t>(x & y);
+        if (c & 0x01)
+            out = ~out;
+    }
+    WRITEBACK();
+    NEXT();
+    CASE(STOP)
+    // Ran off the ROM, this was not an instruction.
+    cycle--;
+    goto done;
+#ifndef HACK_COMPUTED_GOTO
+        }
+    }
+#endif
+
+#undef MEM
+#undef WRITEBACK
+#undef COMP
+#undef CASE
+#undef NEXT
+
+done:
+    mA = a;
+    mD = d;
+    mPc = pc;
+    mCycles += cycle;
+    return cycle;
+}
+
+auto CPUEmulator::dumpRam(std::vector<int> const &addresses, std::ostream &out) -> void
+{
+    writeRamDump(mRam, addresses, out);
+}
@@ -0,0 +1,1268 @@
+#include "CodeWriter.h"
+#include "definitions.h"
+#include <algorithm>
+#include <stdexcept>
+
+auto CodeWriter::emit(std::string const &instruction) -> void
+{
+    mOutputFile << instruction << "\n";
+    mInstructionCount++;
+}
+
+auto CodeWriter::emitLabel(std::string const &label) -> void
+{
+    mOutputFile << "(" << label << ")\n";
+}
+
+auto CodeWriter::uniqueLabel(std::string const &kind) -> std::string
+{
+    return mFunctionName + "$" + kind + std::to_string(mLabelCounter++);
+}
+
+auto CodeWriter::scopedLabel(std::string const &label) -> std::string
+{
+    // VM labels are local to the function they are declared in.
+    return mFunctionName + "$" + label;
+}
+
+auto CodeWriter::setFileName(std::string const &fileName) -> void
+{
+    mFileName = fileName;
+    // Labels outside of any function are scoped by the file.
+    mFunctionName = fileName;
+    mOutputFile << "//////\n";
+    mOutputFile << "// " << fileName << "\n";
+}
+
+// Spill the cached top of stack: *SP = D, SP++
+auto CodeWriter::flush() -> void
+{
+    if (!mTosInD)
+        return;
+    this->emit("@SP");
+    this->emit("M=M+1");
+    this->emit("A=M-1");
+    this->emit("M=D");
+    mTosInD = false;
+}
+
+// Make sure the top of stack is in D: SP--, D = *SP
+auto CodeWriter::popToD() -> void
+{
+    if (mTosInD)
+        return;
+    this->emit("@SP");
+    this->emit("AM=M-1");
+    this->emit("D=M");
+    mTosInD = true;
+}
+
+auto CodeWriter::fixedSymbol(Segment segment, int index) -> std::string
+{
+    if (segment == Segment::STATIC)
+        return "@" + mFileName + "." + std::to_string(index);
+    if (segment == Segment::TEMP)
+        return "@R" + std::to_string(5 + index);
+    if (segment == Segment::POINTER)
+        return index == 0 ? std::string{"@THIS"} : std::string{"@THAT"};
+    return "";
+}
+
+auto CodeWriter::isAddressable(Segment segment, int index, int maxOffset) -> bool
+{
+    if (segment == Segment::STATIC || segment == Segment::TEMP ||
+        segment == Segment::POINTER)
+        return true;
+    return segmentToBase.count(segment) && index <= maxOffset;
+}
+
+// Set A to the address of segment[index] without touching D. Only segments
+// with a fixed address and small offsets into base segments can do that.
+auto CodeWriter::addressOperand(Segment segment, int index, int maxOffset) -> bool
+{
+    if (!this->isAddressable(segment, index, maxOffset))
+        return false;
+    if (segmentToBase.count(segment) == 0)
+    {
+        this->emit(this->fixedSymbol(segment, index));
+        return true;
+    }
+
+    this->emit(std::string{"@"}.append(segmentToBase[segment]));
+    if (index == 0)
+    {
+        this->emit("A=M");
+        return true;
+    }
+    this->emit("A=M+1");
+    for (int i = 1; i < index; i++)
+        this->emit("A=A+1");
+    return true;
+}
+
+// D = segment[index]
+auto CodeWriter::loadSegment(Segment segment, int index) -> void
+{
+    if (segment == Segment::CONST)
+    {
+        if (index == 0 || index == 1)
+        {
+            this->emit("D=" + std::to_string(index));
+        }
+        else
+        {
+            this->emit(std::string{"@"}.append(std::to_string(index)));
+            this->emit("D=A");
+        }
+    }
+    else if (this->addressOperand(segment, index, 2))
+    {
+        this->emit("D=M");
+    }
+    else
+    {
+        this->emit(std::string{"@"}.append(segmentToBase[segment]));
+        this->emit("D=M");
+        this->emit(std::string{"@"}.append(std::to_string(index)));
+        this->emit("A=D+A");
+        this->emit("D=M");
+    }
+}
+
+// segment[index] = D
+auto CodeWriter::storeSegment(Segment segment, int index) -> void
+{
+    if (segment == Segment::CONST)
+        throw std::runtime_error("Cannot pop to the constant segment");
+
+    // Stepping A up is cheaper than the general sequence below up to offset 8.
+    if (this->addressOperand(segment, index, 8))
+    {
+        this->emit("M=D");
+        return;
+    }
+
+    // Without a free register: D = addr + value, A = D - value, M = D - A.
+    this->emit("@R13");
+    this->emit("M=D");
+    this->emit(std::string{"@"}.append(segmentToBase[segment]));
+    this->emit("D=M");
+    this->emit(std::string{"@"}.append(std::to_string(index)));
+    this->emit("D=D+A");
+    this->emit("@R13");
+    this->emit("D=D+M");
+    this->emit("A=D-M");
+    this->emit("M=D-A");
+}
+
+// Combine two operands into D. Either y is in D and x in M (operand is
+// empty), or x is in D and y is the given operand register.
+auto CodeWriter::applyBinary(Command command, std::string const &operand) -> void
+{
+    bool yInD = operand.empty();
+    switch (command)
+    {
+    case Command::ADD:
+        this->emit(yInD ? std::string{"D=D+M"} : "D=D+" + operand);
+        break;
+    case Command::SUB:
+    case Command::EQ:
+    case Command::GT:
+    case Command::LT:
+        this->emit(yInD ? std::string{"D=M-D"} : "D=D-" + operand);
+        break;
+    case Command::AND:
+        this->emit(yInD ? std::string{"D=D&M"} : "D=D&" + operand);
+        break;
+    case Command::OR:
+        this->emit(yInD ? std::string{"D=D|M"} : "D=D|" + operand);
+        break;
+    default:
+        throw std::runtime_error("Not a binary command: " + commandToString[command]);
+    }
+    if (command == Command::EQ || command == Command::GT || command == Command::LT)
+        this->writeCompareResult(command);
+}
+
+// D holds x - y, turn it into the boolean -1/0.
+auto CodeWriter::writeCompareResult(Command command) -> void
+{
+    auto trueLabel = this->uniqueLabel("TRUE");
+    auto endLabel = this->uniqueLabel("ENDBOOL");
+    this->emit(std::string{"@"}.append(trueLabel));
+    this->emit("D;J" + std::string{command == Command::EQ   ? "EQ"
+                                   : command == Command::GT ? "GT"
+                                                            : "LT"});
+    this->emit("D=0");
+    this->emit(std::string{"@"}.append(endLabel));
+    this->emit("0;JMP");
+    this->emitLabel(trueLabel);
+    this->emit("D=-1");
+    this->emitLabel(endLabel);
+}
+
+auto CodeWriter::writeInit() -> void
+{
+    this->emit(std::string{"@"}.append(std::to_string(STACK_BASE)));
+    this->emit("D=A");
+    this->emit("@SP");
+    this->emit("M=D");
+    this->writeCall("Sys.init", 0);
+}
+
+auto CodeWriter::writeArithmetic(Command command) -> void
+{
+    if (command == Command::NEG || command == Command::NOT)
+    {
+        std::string op = command == Command::NEG ? "-" : "!";
+        if (mTosInD)
+        {
+            this->emit("D=" + op + "D");
+        }
+        else
+        {
+            this->emit("@SP");
+            this->emit("A=M-1");
+            this->emit("M=" + op + "M");
+        }
+        return;
+    }
+
+    // y in D, x in M
+    this->popToD();
+    if (mSizeOptimized &&
+        (command == Command::EQ || command == Command::GT || command == Command::LT))
+    {
+        this->writeSharedCompare(command);
+        return;
+    }
+    this->emit("@SP");
+    this->emit("AM=M-1");
+    this->applyBinary(command, "");
+}
+
+auto CodeWriter::writePush(Segment segment, int index) -> void
+{
+    this->flush();
+    this->loadSegment(segment, index);
+    mTosInD = true;
+}
+
+auto CodeWriter::writePop(Segment segment, int index) -> void
+{
+    if (!mTosInD && segmentToBase.count(segment) && index > 4)
+    {
+        // D = addr + value, A = D - value, M = D - A
+        this->emit(std::string{"@"}.append(segmentToBase[segment]));
+        this->emit("D=M");
+        this->emit(std::string{"@"}.append(std::to_string(index)));
+        this->emit("D=D+A");
+        this->emit("@SP");
+        this->emit("AM=M-1");
+        this->emit("D=D+M");
+        this->emit("A=D-M");
+        this->emit("M=D-A");
+        return;
+    }
+    this->popToD();
+    this->storeSegment(segment, index);
+    mTosInD = false;
+}
+
+auto CodeWriter::writeLabel(std::string const &label) -> void
+{
+    this->flush();
+    this->emitLabel(this->scopedLabel(label));
+}
+
+auto CodeWriter::writeGoto(std::string const &label) -> void
+{
+    this->flush();
+    this->emit(std::string{"@"}.append(this->scopedLabel(label)));
+    this->emit("0;JMP");
+}
+
+auto CodeWriter::writeIf(std::string const &label) -> void
+{
+    this->popToD();
+    this->emit(std::string{"@"}.append(this->scopedLabel(label)));
+    this->emit("D;JNE");
+    mTosInD = false;
+}
+
+// Push LCL, ARG, THIS, THAT behind the return address at *SP and set
+// LCL = SP. Leaves D = SP.
+auto CodeWriter::writeFrameSave() -> void
+{
+    for (auto pointer : {"LCL", "ARG", "THIS", "THAT"})
+    {
+        this->emit(std::string{"@"}.append(pointer));
+        this->emit("D=M");
+        this->emit("@SP");
+        this->emit("AM=M+1");
+        this->emit("M=D");
+    }
+    this->emit("@SP");
+    this->emit("MD=M+1");
+    this->emit("@LCL");
+    this->emit("M=D");
+}
+
+// Restore THAT, THIS, ARG, LCL by walking LCL down the saved frame, then
+// jump to the return address in R14.
+auto CodeWriter::writeFrameRestore() -> void
+{
+    for (auto pointer : {"THAT", "THIS", "ARG", "LCL"})
+    {
+        this->emit("@LCL");
+        this->emit("AM=M-1");
+        this->emit("D=M");
+        this->emit(std::string{"@"}.append(pointer));
+        this->emit("M=D");
+    }
+    this->emit("@R14");
+    this->emit("A=M");
+    this->emit("0;JMP");
+}
+
+auto CodeWriter::writeCall(std::string const &functionName, int nArgs) -> void
+{
+    if (mSizeOptimized)
+    {
+        this->writeSharedCall(functionName, nArgs);
+        return;
+    }
+    auto returnLabel = this->uniqueLabel("ret.");
+
+    // push return-address, LCL, ARG, THIS, THAT. SP is only moved past the
+    // first frame word by the AM=M+1 of the following ones.
+    if (mTosInD)
+    {
+        // Store the last argument and the return address in one go.
+        this->emit("@SP");
+        this->emit("A=M");
+        this->emit("M=D");
+        this->emit(std::string{"@"}.append(returnLabel));
+        this->emit("D=A");
+        this->emit("@SP");
+        this->emit("AM=M+1");
+        this->emit("M=D");
+        mTosInD = false;
+    }
+    else
+    {
+        this->emit(std::string{"@"}.append(returnLabel));
+        this->emit("D=A");
+        this->emit("@SP");
+        this->emit("A=M");
+        this->emit("M=D");
+    }
+    this->writeFrameSave();
+    // ARG = SP - (nArgs + 5)
+    this->emit(std::string{"@"}.append(std::to_string(nArgs + 5)));
+    this->emit("D=D-A");
+    this->emit("@ARG");
+    this->emit("M=D");
+    // goto f
+    this->emit(std::string{"@"}.append(functionName));
+    this->emit("0;JMP");
+    this->emitLabel(returnLabel);
+}
+
+// *R13++ = *R14++
+auto CodeWriter::copyWord() -> void
+{
+    this->emit("@R14");
+    this->emit("AM=M+1");
+    this->emit("A=A-1");
+    this->emit("D=M");
+    this->emit("@R13");
+    this->emit("AM=M+1");
+    this->emit("A=A-1");
+    this->emit("M=D");
+}
+
+// call f; return in the caller's frame, f returns straight to our caller. With
+// as many arguments as the caller they are moved down to ARG inline, all other
+// cases are left to the shared $TAILCALL.
+auto CodeWriter::writeTailCall(std::string const &functionName, int nArgs) -> void
+{
+    this->flush();
+    auto sharedLabel = this->uniqueLabel("tailcall.");
+    if (!mSizeOptimized)
+    {
+        // Caller's nArgs = LCL - ARG - 5
+        this->emit("@ARG");
+        this->emit("D=M");
+        this->emit("@LCL");
+        this->emit("D=M-D");
+        this->emit("@" + std::to_string(nArgs + 5));
+        this->emit("D=D-A");
+        this->emit("@" + sharedLabel);
+        this->emit("D;JNE");
+        if (nArgs > 0)
+        {
+            // R13 = ARG, R14 = SP - nArgs
+            this->emit("@ARG");
+            this->emit("D=M");
+            this->emit("@R13");
+            this->emit("M=D");
+            this->emit("@SP");
+            this->emit("D=M");
+            this->emit("@" + std::to_string(nArgs));
+            this->emit("D=D-A");
+            this->emit("@R14");
+            this->emit("M=D");
+            for (int i = 0; i < nArgs; i++)
+                this->copyWord();
+        }
+        // SP = LCL, goto f
+        this->emit("@LCL");
+        this->emit("D=M");
+        this->emit("@SP");
+        this->emit("M=D");
+        this->emit("@" + functionName);
+        this->emit("0;JMP");
+        this->emitLabel(sharedLabel);
+    }
+
+    // R13 = callee, R14 = nArgs
+    mSharedRoutineUses["$TAILCALL"]++;
+    this->emit("@" + functionName);
+    this->emit("D=A");
+    this->emit("@R13");
+    this->emit("M=D");
+    if (nArgs <= 1)
+    {
+        this->emit("@R14");
+        this->emit("M=" + std::to_string(nArgs));
+    }
+    else
+    {
+        this->emit("@" + std::to_string(nArgs));
+        this->emit("D=A");
+        this->emit("@R14");
+        this->emit("M=D");
+    }
+    this->emit("@$TAILCALL");
+    this->emit("0;JMP");
+}
+
+auto CodeWriter::writeReturn() -> void
+{
+    if (mSizeOptimized)
+    {
+        mSharedRoutineUses[mTosInD ? "$RETURN_D" : "$RETURN"]++;
+        this->emit(mTosInD ? std::string{"@$RETURN_D"} : std::string{"@$RETURN"});
+        this->emit("0;JMP");
+        mTosInD = false;
+        return;
+    }
+    // The return value must be read before *ARG is overwritten, and the
+    // return address before that, as *ARG is the same word for nArgs == 0.
+    if (mTosInD)
+    {
+        this->emit("@R13");
+        this->emit("M=D");
+    }
+    // R14 = RET = *(LCL - 5)
+    this->emit("@LCL");
+    this->emit("D=M");
+    this->emit("@5");
+    this->emit("A=D-A");
+    this->emit("D=M");
+    this->emit("@R14");
+    this->emit("M=D");
+    // *ARG = return value
+    if (mTosInD)
+    {
+        this->emit("@R13");
+        this->emit("D=M");
+    }
+    else
+    {
+        this->emit("@SP");
+        this->emit("AM=M-1");
+        this->emit("D=M");
+    }
+    this->emit("@ARG");
+    this->emit("A=M");
+    this->emit("M=D");
+    // SP = ARG + 1, A still holds ARG
+    this->emit("D=A+1");
+    this->emit("@SP");
+    this->emit("M=D");
+    this->writeFrameRestore();
+    mTosInD = false;
+}
+
+auto CodeWriter::writeFunction(std::string const &functionName, int nLocals) -> void
+{
+    this->flush();
+    mFunctionName = functionName;
+    this->emitLabel(functionName);
+    if (nLocals == 0)
+        return;
+
+    if (nLocals == 1)
+    {
+        this->emit("@SP");
+        this->emit("M=M+1");
+        this->emit("A=M-1");
+        this->emit("M=0");
+        return;
+    }
+
+    // Zero the locals in place, then move SP past them once.
+    this->emit("@SP");
+    this->emit("A=M");
+    this->emit("M=0");
+    for (int i = 1; i < nLocals; i++)
+    {
+        this->emit("A=A+1");
+        this->emit("M=0");
+    }
+    this->emit("D=A+1");
+    this->emit("@SP");
+    this->emit("M=D");
+}
+
+// Try to lower the commands starting at i as one unit. Returns the number of
+// commands consumed, 0 if no pattern applies.
+auto CodeWriter::matchPattern(std::vector<VMCommand> const &commands, size_t i) -> size_t
+{
+    if (i + 1 >= commands.size())
+        return 0;
+    auto const &first = commands[i];
+    auto const &second = commands[i + 1];
+
+    if (first.type != CommandType::PUSH || second.type != CommandType::ARITHMETIC)
+        return 0;
+
+    // push constant 0; not  /  push constant 1; neg  =>  D=-1
+    if (first.segment == Segment::CONST &&
+        ((first.index == 0 && second.command == Command::NOT) ||
+         (first.index == 1 && second.command == Command::NEG)))
+    {
+        this->flush();
+        this->emit("D=-1");
+        mTosInD = true;
+        return 2;
+    }
+
+    if (second.command == Command::NEG || second.command == Command::NOT)
+        return 0;
+
+    bool addOrSub = second.command == Command::ADD || second.command == Command::SUB;
+    if (first.segment == Segment::CONST)
+    {
+        // push constant 0; add|sub
+        if (addOrSub && first.index == 0)
+            return 2;
+
+        // push constant 1; add|sub  =>  in place increment
+        if (addOrSub && first.index == 1)
+        {
+            std::string op = second.command == Command::ADD ? "+" : "-";
+            if (mTosInD)
+            {
+                this->emit("D=D" + op + "1");
+            }
+            else
+            {
+                this->emit("@SP");
+                this->emit("A=M-1");
+                this->emit("M=M" + op + "1");
+            }
+            return 2;
+        }
+
+        // x in D, y as immediate in A
+        this->popToD();
+        this->emit(std::string{"@"}.append(std::to_string(first.index)));
+        this->applyBinary(second.command, "A");
+        return 2;
+    }
+
+    // x in D, y addressed in M
+    if (!this->isAddressable(first.segment, first.index, 3))
+        return 0;
+    this->popToD();
+    this->addressOperand(first.segment, first.index, 3);
+    this->applyBinary(second.command, "M");
+    return 2;
+}
+
+// Branch on a comparison without producing its boolean: [push y;] eq|gt|lt;
+// [not;] if-goto L jumps on x - y directly, with the inverted condition after
+// the not. A not right before an if-goto is folded into the jump as well.
+// Returns the number of commands consumed, 0 if the pattern does not apply.
+auto CodeWriter::matchBranch(std::vector<VMCommand> const &commands, size_t i) -> size_t
+{
+    auto isArithmetic = [&](size_t j, std::initializer_list<Command> kinds) {
+        return j < commands.size() && commands[j].type == CommandType::ARITHMETIC &&
+               std::find(kinds.begin(), kinds.end(), commands[j].command) != kinds.end();
+    };
+    size_t j = i;
+    VMCommand const *operand = nullptr;
+    if (commands[j].type == CommandType::PUSH)
+        operand = &commands[j++];
+    auto comparison = Command::NONE;
+    if (isArithmetic(j, {Command::EQ, Command::GT, Command::LT}))
+        comparison = commands[j++].command;
+    bool negated = isArithmetic(j, {Command::NOT});
+    if (negated)
+        j++;
+    if (j >= commands.size() || commands[j].type != CommandType::IF)
+        return 0;
+    if (comparison == Command::NONE && (operand != nullptr || !negated))
+        return 0;
+    if (operand != nullptr && operand->segment != Segment::CONST &&
+        !this->isAddressable(operand->segment, operand->index, 3))
+        return 0;
+
+    this->popToD();
+    auto target = "@" + this->scopedLabel(commands[j].name);
+    if (comparison == Command::NONE)
+    {
+        // not x is 0 only for x = -1
+        this->emit(target);
+        this->emit("D+1;JNE");
+        mTosInD = false;
+        return j + 1 - i;
+    }
+
+    // D = x - y
+    if (operand == nullptr)
+    {
+        this->emit("@SP");
+        this->emit("AM=M-1");
+        this->emit("D=M-D");
+    }
+    else if (operand->segment == Segment::CONST && operand->index <= 1)
+    {
+        if (operand->index == 1)
+            this->emit("D=D-1");
+    }
+    else if (operand->segment == Segment::CONST)
+    {
+        this->emit("@" + std::to_string(operand->index));
+        this->emit("D=D-A");
+    }
+    else
+    {
+        this->addressOperand(operand->segment, operand->index, 3);
+        this->emit("D=D-M");
+    }
+    std::string condition;
+    if (comparison == Command::EQ)
+        condition = negated ? "NE" : "EQ";
+    else if (comparison == Command::GT)
+        condition = negated ? "LE" : "GT";
+    else
+        condition = negated ? "GE" : "LT";
+    this->emit(target);
+    this->emit("D;J" + condition);
+    mTosInD = false;
+    return j + 1 - i;
+}
+
+// Calls of Math.multiply, Math.divide, Memory.peek and Memory.poke without a
+// frame. The result is left in D, of Math.divide on the stack, where it ends
+// up after the calls of Math.divide it falls back to. Returns false for other
+// functions.
+auto CodeWriter::writeIntrinsic(std::string const &functionName, int nArgs) -> bool
+{
+    if (functionName == "Memory.peek" && nArgs == 1)
+    {
+        this->popToD();
+        this->emit("A=D");
+        this->emit("D=M");
+        return true;
+    }
+    if (functionName == "Memory.poke" && nArgs == 2)
+    {
+        // D = address + value, A = D - value, M = D - A, then return 0.
+        this->popToD();
+        this->emit("@R13");
+        this->emit("M=D");
+        this->emit("@SP");
+        this->emit("AM=M-1");
+        this->emit("D=M");
+        this->emit("@R13");
+        this->emit("D=D+M");
+        this->emit("A=D-M");
+        this->emit("M=D-A");
+        this->emit("D=0");
+        return true;
+    }
+    if ((functionName != "Math.multiply" && functionName != "Math.divide") || nArgs != 2)
+        return false;
+
+    // x on the stack, R14 = y, D = return address. Not ret. like calls,
+    // profilers tell returns from functions by the label.
+    bool multiply = functionName == "Math.multiply";
+    auto routine = multiply ? std::string{"$MULTIPLY"} : std::string{"$DIVIDE"};
+    auto returnLabel = this->uniqueLabel(multiply ? "mul." : "div.");
+    mSharedRoutineUses[routine]++;
+
+    this->popToD();
+    this->emit("@R14");
+    this->emit("M=D");
+    this->emit("@" + returnLabel);
+    this->emit("D=A");
+    this->emit("@" + routine);
+    this->emit("0;JMP");
+    this->emitLabel(returnLabel);
+    mTosInD = multiply;
+    return true;
+}
+
+// Intrinsic calls, and multiplications by a constant 2^k, pushed as either
+// operand, as k additions. Returns the number of commands consumed, 0 without intrinsics
+// or if the pattern does not apply.
+auto CodeWriter::matchIntrinsic(std::vector<VMCommand> const &commands, size_t i) -> size_t
+{
+    if (!mIntrinsics)
+        return 0;
+    auto const &first = commands[i];
+    if (first.type == CommandType::CALL)
+        return this->writeIntrinsic(first.name, first.index) ? 1 : 0;
+
+    auto isMultiply = [&](size_t k) {
+        return k < commands.size() && commands[k].type == CommandType::CALL &&
+               commands[k].name == "Math.multiply" && commands[k].index == 2;
+    };
+    if (first.type != CommandType::PUSH || first.segment != Segment::CONST ||
+        (first.index & (first.index - 1)) != 0)
+        return 0;
+
+    // 2^k as y: x is already on the stack. As x: load y into D.
+    size_t consumed = 0;
+    if (isMultiply(i + 1))
+    {
+        this->popToD();
+        consumed = 2;
+    }
+    else if (i + 1 < commands.size() && commands[i + 1].type == CommandType::PUSH &&
+             isMultiply(i + 2))
+    {
+        this->flush();
+        this->loadSegment(commands[i + 1].segment, commands[i + 1].index);
+        consumed = 3;
+    }
+    else
+        return 0;
+
+    if (first.index == 0)
+        this->emit("D=0");
+    else if (first.index > 1)
+        this->emit("@R13");
+    for (int power = 1; power < first.index; power *= 2)
+    {
+        this->emit("M=D");
+        this->emit("D=D+M");
+    }
+    mTosInD = true;
+    return consumed;
+}
+
+auto CodeWriter::translate(std::vector<VMCommand> const &commands) -> void
+{
+    size_t i = 0;
+    while (i < commands.size())
+    {
+        auto consumed = this->matchBranch(commands, i);
+        if (consumed == 0)
+            consumed = this->matchIntrinsic(commands, i);
+        if (consumed == 0)
+            consumed = this->matchPattern(commands, i);
+        if (consumed > 0)
+        {
+            i += consumed;
+            continue;
+        }
+
+        auto const &command = commands[i];
+        switch (command.type)
+        {
+        case CommandType::ARITHMETIC:
+            this->writeArithmetic(command.command);
+            break;
+        case CommandType::PUSH:
+            this->writePush(command.segment, command.index);
+            break;
+        case CommandType::POP:
+            this->writePop(command.segment, command.index);
+            break;
+        case CommandType::LABEL:
+            this->writeLabel(command.name);
+            break;
+        case CommandType::GOTO:
+            this->writeGoto(command.name);
+            break;
+        case CommandType::IF:
+            this->writeIf(command.name);
+            break;
+        case CommandType::FUNCTION:
+            this->writeFunction(command.name, command.index);
+            break;
+        case CommandType::RETURN:
+            this->writeReturn();
+            break;
+        case CommandType::CALL:
+            if (mTailCalls && i + 1 < commands.size() &&
+                commands[i + 1].type == CommandType::RETURN)
+            {
+                this->writeTailCall(command.name, command.index);
+                i++;
+                break;
+            }
+            this->writeCall(command.name, command.index);
+            break;
+        }
+        i++;
+    }
+    this->flush();
+}
+
+// Size optimized call: R13 = callee, R14 = nArgs, D = return address.
+auto CodeWriter::writeSharedCall(std::string const &functionName, int nArgs) -> void
+{
+    this->flush();
+    auto returnLabel = this->uniqueLabel("ret.");
+    mSharedRoutineUses["$CALL"]++;
+
+    this->emit(std::string{"@"}.append(functionName));
+    this->emit("D=A");
+    this->emit("@R13");
+    this->emit("M=D");
+    if (nArgs <= 1)
+    {
+        this->emit("@R14");
+        this->emit("M=" + std::to_string(nArgs));
+    }
+    else
+    {
+        this->emit(std::string{"@"}.append(std::to_string(nArgs)));
+        this->emit("D=A");
+        this->emit("@R14");
+        this->emit("M=D");
+    }
+    this->emit(std::string{"@"}.append(returnLabel));
+    this->emit("D=A");
+    this->emit("@$CALL");
+    this->emit("0;JMP");
+    this->emitLabel(returnLabel);
+}
+
+// Size optimized comparison: y in D, x on the stack. R13 = y, D = return
+// address, the routine leaves the boolean in D.
+auto CodeWriter::writeSharedCompare(Command command) -> void
+{
+    auto routine = "$" + commandToString[command];
+    // Not ret. like calls, profilers tell returns from functions by the label.
+    auto returnLabel = this->uniqueLabel("cmp.");
+    mSharedRoutineUses[routine]++;
+
+    this->emit("@R13");
+    this->emit("M=D");
+    this->emit(std::string{"@"}.append(returnLabel));
+    this->emit("D=A");
+    this->emit(std::string{"@"}.append(routine));
+    this->emit("0;JMP");
+    this->emitLabel(returnLabel);
+    mTosInD = true;
+}
+
+// x * y modulo 2^16 for intrinsic calls: x at SP - 1, R14 = y, D = return
+// address. The set bits of y are cleared one at a time with the mask in R15,
+// adding x shifted along to the product, which replaces x on the stack. y is
+// made non-negative and the smaller one, so the loop ends early.
+auto CodeWriter::writeSharedMultiply() -> void
+{
+    this->emitLabel("$MULTIPLY");
+    this->emit("@SP");
+    this->emit("A=M");
+    this->emit("M=D");
+    this->emit("A=A-1");
+    this->emit("D=M");
+    this->emit("M=0");
+    this->emit("@R13");
+    this->emit("M=D");
+    // (-x) * (-y) = x * y
+    this->emit("@R14");
+    this->emit("D=M");
+    this->emit("@$MULTIPLY$POSITIVE");
+    this->emit("D;JGE");
+    this->emit("@R14");
+    this->emit("M=-D");
+    this->emit("@R13");
+    this->emit("M=-M");
+    // Swap if 0 <= x < y, D = x - y.
+    this->emitLabel("$MULTIPLY$POSITIVE");
+    this->emit("@R13");
+    this->emit("D=M");
+    this->emit("@$MULTIPLY$START");
+    this->emit("D;JLT");
+    this->emit("@R14");
+    this->emit("D=D-M");
+    this->emit("@$MULTIPLY$START");
+    this->emit("D;JGE");
+    this->emit("@R13");
+    this->emit("M=M-D");
+    this->emit("@R14");
+    this->emit("M=M+D");
+    this->emitLabel("$MULTIPLY$START");
+    this->emit("@R15");
+    this->emit("M=1");
+    this->emit("@R14");
+    this->emit("D=M");
+    this->emit("@$MULTIPLY$END");
+    this->emit("D;JEQ");
+    this->emitLabel("$MULTIPLY$LOOP");
+    this->emit("@R15");
+    this->emit("D=M");
+    this->emit("@R14");
+    this->emit("D=D&M");
+    this->emit("@$MULTIPLY$NEXT");
+    this->emit("D;JEQ");
+    this->emit("@R14");
+    this->emit("M=M-D");
+    this->emit("@R13");
+    this->emit("D=M");
+    this->emit("@SP");
+    this->emit("A=M-1");
+    this->emit("M=D+M");
+    this->emitLabel("$MULTIPLY$NEXT");
+    this->emit("@R13");
+    this->emit("D=M");
+    this->emit("M=D+M");
+    this->emit("@R15");
+    this->emit("D=M");
+    this->emit("M=D+M");
+    this->emit("@R14");
+    this->emit("D=M");
+    this->emit("@$MULTIPLY$LOOP");
+    this->emit("D;JNE");
+    // Pop the product into D, the return address is right above it.
+    this->emitLabel("$MULTIPLY$END");
+    this->emit("@SP");
+    this->emit("AM=M-1");
+    this->emit("D=M");
+    this->emit("A=A+1");
+    this->emit("A=M");
+    this->emit("0;JMP");
+}
+
+// x / y rounded towards zero like the OS for intrinsic calls: x at SP - 1,
+// R14 = y, D = return address. Long division of |x| by |y|, unrolled over its
+// 15 bits: the remainder in R15 takes up the bits shifted out of the top of
+// R13, which takes up the quotient bits at the bottom. The word of x decides
+// the sign, flipped for a negative y. Division by zero and -32768, which has
+// no absolute value, are left to a regular call of Math.divide.
+auto CodeWriter::writeSharedDivide() -> void
+{
+    this->emitLabel("$DIVIDE");
+    this->emit("@SP");
+    this->emit("A=M");
+    this->emit("M=D");
+    this->emit("A=A-1");
+    this->emit("D=M");
+    this->emit("@R13");
+    this->emit("M=D");
+    // D + 32767 + 1 is 0 for -32768 only.
+    this->emit("@32767");
+    this->emit("D=D+A");
+    this->emit("D=D+1");
+    this->emit("@$DIVIDE$CALL");
+    this->emit("D;JEQ");
+    this->emit("@R14");
+    this->emit("D=M");
+    this->emit("@$DIVIDE$CALL");
+    this->emit("D;JEQ");
+    this->emit("@32767");
+    this->emit("D=D+A");
+    this->emit("D=D+1");
+    this->emit("@$DIVIDE$CALL");
+    this->emit("D;JEQ");
+    this->emit("@R14");
+    this->emit("D=M");
+    this->emit("@$DIVIDE$Y");
+    this->emit("D;JGE");
+    this->emit("@R14");
+    this->emit("M=-D");
+    this->emit("@SP");
+    this->emit("A=M-1");
+    this->emit("M=!M");
+    this->emitLabel("$DIVIDE$Y");
+    this->emit("@R13");
+    this->emit("D=M");
+    this->emit("@$DIVIDE$X");
+    this->emit("D;JGE");
+    this->emit("@R13");
+    this->emit("MD=-D");
+    this->emitLabel("$DIVIDE$X");
+    this->emit("@R14");
+    this->emit("D=D-M");
+    this->emit("@$DIVIDE$ZERO");
+    this->emit("D;JLT");
+    this->emit("@R15");
+    this->emit("M=0");
+    // The top bit of |x| is 0.
+    this->emit("@R13");
+    this->emit("D=M");
+    this->emit("M=D+M");
+    for (int bit = 14; bit >= 0; bit--)
+    {
+        auto shifted = "$DIVIDE$SHIFT" + std::to_string(bit);
+        auto next = "$DIVIDE$NEXT" + std::to_string(bit);
+        this->emit("@R15");
+        this->emit("D=M");
+        this->emit("M=D+M");
+        this->emit("@R13");
+        this->emit("D=M");
+        this->emit("@" + shifted);
+        this->emit("D;JGE");
+        this->emit("@R15");
+        this->emit("M=M+1");
+        this->emitLabel(shifted);
+        this->emit("@R13");
+        this->emit("M=D+M");
+        // The remainder may reach 2^16 - 2, r - y is right even if it overflowed.
+        this->emit("@R14");
+        this->emit("D=M");
+        this->emit("@R15");
+        this->emit("D=M-D");
+        this->emit("@" + next);
+        this->emit("D;JLT");
+        this->emit("@R15");
+        this->emit("M=D");
+        this->emit("@R13");
+        this->emit("M=M+1");
+        this->emitLabel(next);
+    }
+    this->emit("@SP");
+    this->emit("A=M-1");
+    this->emit("D=M");
+    this->emit("@$DIVIDE$POSITIVE");
+    this->emit("D;JGE");
+    this->emit("@R13");
+    this->emit("M=-M");
+    this->emitLabel("$DIVIDE$POSITIVE");
+    this->emit("@R13");
+    this->emit("D=M");
+    // The quotient replaces x, the return address is right above it.
+    this->emitLabel("$DIVIDE$END");
+    this->emit("@SP");
+    this->emit("A=M-1");
+    this->emit("M=D");
+    this->emit("A=A+1");
+    this->emit("A=M");
+    this->emit("0;JMP");
+    this->emitLabel("$DIVIDE$ZERO");
+    this->emit("D=0");
+    this->emit("@$DIVIDE$END");
+    this->emit("0;JMP");
+    // push y; call Math.divide 2 through $CALL, returning to the caller.
+    this->emitLabel("$DIVIDE$CALL");
+    this->emit("@SP");
+    this->emit("A=M");
+    this->emit("D=M");
+    this->emit("@R15");
+    this->emit("M=D");
+    this->emit("@R14");
+    this->emit("D=M");
+    this->emit("@SP");
+    this->emit("M=M+1");
+    this->emit("A=M-1");
+    this->emit("M=D");
+    this->emit("@Math.divide");
+    this->emit("D=A");
+    this->emit("@R13");
+    this->emit("M=D");
+    this->emit("@2");
+    this->emit("D=A");
+    this->emit("@R14");
+    this->emit("M=D");
+    this->emit("@R15");
+    this->emit("D=M");
+    this->emit("@$CALL");
+    this->emit("0;JMP");
+}
+
+// Emit the shared routines used by the size optimized lowering and the
+// intrinsics, once each.
+auto CodeWriter::writeSharedRoutines() -> void
+{
+    if (mSharedRoutineUses.empty())
+        return;
+    mOutputFile << "//////\n";
+    mOutputFile << "// shared routines\n";
+
+    if (mSharedRoutineUses.count("$TAILCALL"))
+    {
+        // D = caller's nArgs - nArgs = LCL - ARG - 5 - R14
+        this->emitLabel("$TAILCALL");
+        this->emit("@ARG");
+        this->emit("D=M");
+        this->emit("@LCL");
+        this->emit("D=M-D");
+        this->emit("@5");
+        this->emit("D=D-A");
+        this->emit("@R14");
+        this->emit("D=D-M");
+        this->emit("@$TAILCALL$CALL");
+        this->emit("D;JLT");
+        // The callee waits in the free word at SP. R15 = nArgs arguments are
+        // moved down from R14 = SP - nArgs to R13 = ARG.
+        this->emit("@R13");
+        this->emit("D=M");
+        this->emit("@SP");
+        this->emit("A=M");
+        this->emit("M=D");
+        this->emit("@R14");
+        this->emit("D=M");
+        this->emit("@R15");
+        this->emit("M=D");
+        this->emit("@SP");
+        this->emit("D=M-D");
+        this->emit("@R14");
+        this->emit("M=D");
+        this->emit("@ARG");
+        this->emit("D=M");
+        this->emit("@R13");
+        this->emit("M=D");
+        this->emit("@R15");
+        this->emit("D=M");
+        this->emit("@$TAILCALL$FRAME");
+        this->emit("D;JEQ");
+        this->emitLabel("$TAILCALL$ARGS");
+        this->copyWord();
+        this->emit("@R15");
+        this->emit("MD=M-1");
+        this->emit("@$TAILCALL$ARGS");
+        this->emit("D;JGT");
+        // The saved frame follows them unless it is already in place.
+        this->emitLabel("$TAILCALL$FRAME");
+        this->emit("@LCL");
+        this->emit("D=M");
+        this->emit("@5");
+        this->emit("D=D-A");
+        this->emit("@R14");
+        this->emit("M=D");
+        this->emit("@R13");
+        this->emit("D=D-M");
+        this->emit("@$TAILCALL$JUMP");
+        this->emit("D;JEQ");
+        for (int i = 0; i < 5; i++)
+            this->copyWord();
+        this->emit("@R13");
+        this->emit("D=M");
+        this->emit("@LCL");
+        this->emit("M=D");
+        // SP = LCL, goto callee
+        this->emitLabel("$TAILCALL$JUMP");
+        this->emit("@SP");
+        this->emit("A=M");
+        this->emit("D=M");
+        this->emit("@R15");
+        this->emit("M=D");
+        this->emit("@LCL");
+        this->emit("D=M");
+        this->emit("@SP");
+        this->emit("M=D");
+        this->emit("@R15");
+        this->emit("A=M");
+        this->emit("0;JMP");
+        // No room for the arguments: a regular call that returns into $RETURN
+        this->emitLabel("$TAILCALL$CALL");
+        this->emit("@$RETURN");
+        this->emit("D=A");
+        this->emit("@$CALL");
+        this->emit("0;JMP");
+    }
+
+    if (mSharedRoutineUses.count("$MULTIPLY"))
+        this->writeSharedMultiply();
+    if (mSharedRoutineUses.count("$DIVIDE"))
+        this->writeSharedDivide();
+
+    if (mSharedRoutineUses.count("$CALL") || mSharedRoutineUses.count("$TAILCALL") ||
+        mSharedRoutineUses.count("$DIVIDE"))
+    {
+        // push D (return address), LCL, ARG, THIS, THAT
+        this->emitLabel("$CALL");
+        this->emit("@SP");
+        this->emit("A=M");
+        this->emit("M=D");
+        this->writeFrameSave();
+        // ARG = SP - nArgs - 5
+        this->emit("@R14");
+        this->emit("D=D-M");
+        this->emit("@5");
+        this->emit("D=D-A");
+        this->emit("@ARG");
+        this->emit("M=D");
+        this->emit("@R13");
+        this->emit("A=M");
+        this->emit("0;JMP");
+    }
+
+    if (mSharedRoutineUses.count("$RETURN") || mSharedRoutineUses.count("$RETURN_D") ||
+        mSharedRoutineUses.count("$TAILCALL"))
+    {
+        // Return value on the stack, or already in D.
+        this->emitLabel("$RETURN");
+        this->emit("@SP");
+        this->emit("AM=M-1");
+        this->emit("D=M");
+        this->emitLabel("$RETURN_D");
+        this->emit("@R13");
+        this->emit("M=D");
+        this->emit("@LCL");
+        this->emit("D=M");
+        this->emit("@5");
+        this->emit("A=D-A");
+        this->emit("D=M");
+        this->emit("@R14");
+        this->emit("M=D");
+        this->emit("@R13");
+        this->emit("D=M");
+        this->emit("@ARG");
+        this->emit("A=M");
+        this->emit("M=D");
+        this->emit("D=A+1");
+        this->emit("@SP");
+        this->emit("M=D");
+        this->writeFrameRestore();
+    }
+
+    for (auto command : {Command::EQ, Command::GT, Command::LT})
+    {
+        auto routine = "$" + commandToString[command];
+        if (!mSharedRoutineUses.count(routine))
+            continue;
+        auto jump = commandToString[command];
+        std::transform(jump.begin(), jump.end(), jump.begin(), ::toupper);
+        this->emitLabel(routine);
+        this->emit("@R15");
+        this->emit("M=D");
+        this->emit("@R13");
+        this->emit("D=M");
+        this->emit("@SP");
+        this->emit("AM=M-1");
+        this->emit("D=M-D");
+        this->emit("@" + routine + "$TRUE");
+        this->emit("D;J" + jump);
+        this->emit("D=0");
+        this->emit("@R15");
+        this->emit("A=M");
+        this->emit("0;JMP");
+        this->emitLabel(routine + "$TRUE");
+        this->emit("D=-1");
+        this->emit("@R15");
+        this->emit("A=M");
+        this->emit("0;JMP");
+    }
+}
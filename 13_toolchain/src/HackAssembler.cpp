@@ -0,0 +1,200 @@
+#include "HackAssembler.h"
+#include "AsmOptimizer.h"
+#include "definitions.h"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <tuple>
+
+// a bit and c1-c6 of the canonical comps.
+inline const std::map<std::string, uint16_t> compBits{
+    {"0", 0b0101010},   {"1", 0b0111111},   {"-1", 0b0111010},  {"D", 0b0001100},
+    {"A", 0b0110000},   {"!D", 0b0001101},  {"!A", 0b0110001},  {"-D", 0b0001111},
+    {"-A", 0b0110011},  {"D+1", 0b0011111}, {"A+1", 0b0110111}, {"D-1", 0b0001110},
+    {"A-1", 0b0110010}, {"D+A", 0b0000010}, {"A+D", 0b0000010}, {"D-A", 0b0010011},
+    {"A-D", 0b0000111}, {"D&A", 0b0000000}, {"A&D", 0b0000000}, {"D|A", 0b0010101},
+    {"A|D", 0b0010101}, {"M", 0b1110000},   {"!M", 0b1110001},  {"-M", 0b1110011},
+    {"M+1", 0b1110111}, {"M-1", 0b1110010}, {"D+M", 0b1000010}, {"M+D", 0b1000010},
+    {"D-M", 0b1010011}, {"M-D", 0b1000111}, {"D&M", 0b1000000}, {"M&D", 0b1000000},
+    {"D|M", 0b1010101}, {"M|D", 0b1010101},
+};
+
+inline const std::map<std::string, uint16_t> jumpBits{
+    {"JGT", 1}, {"JEQ", 2}, {"JGE", 3}, {"JLT", 4}, {"JNE", 5}, {"JLE", 6}, {"JMP", 7},
+};
+
+inline const std::map<std::string, int> predefinedSymbols{
+    {"SP", 0},   {"LCL", 1},  {"ARG", 2},  {"THIS", 3},         {"THAT", 4},
+    {"R0", 0},   {"R1", 1},   {"R2", 2},   {"R3", 3},           {"R4", 4},
+    {"R5", 5},   {"R6", 6},   {"R7", 7},   {"R8", 8},           {"R9", 9},
+    {"R10", 10}, {"R11", 11}, {"R12", 12}, {"R13", 13},         {"R14", 14},
+    {"R15", 15}, {"SCREEN", SCREEN_BASE},  {"KBD", KBD_ADDRESS},
+};
+
+auto HackAssembler::resolve(std::string const &symbol) -> int
+{
+    auto found = mSymbols.find(symbol);
+    if (found != mSymbols.end())
+        return found->second;
+    mSymbols[symbol] = mNextVariable;
+    return mNextVariable++;
+}
+
+auto HackAssembler::relocate(std::string const &symbol, int address, HackObject &object)
+    -> int
+{
+    auto predefined = predefinedSymbols.find(symbol);
+    if (predefined != predefinedSymbols.end())
+        return predefined->second;
+    auto label = mLabels.find(symbol);
+    if (label != mLabels.end())
+    {
+        object.localRelocations.push_back(static_cast<uint16_t>(address));
+        return label->second;
+    }
+    auto external = mExternals.emplace(symbol, static_cast<int>(object.externals.size()));
+    if (external.second)
+        object.externals.push_back(symbol);
+    object.externalRelocations.push_back(
+        {static_cast<uint16_t>(address), external.first->second});
+    return 0;
+}
+
+auto HackAssembler::assemble(std::istream &source, std::string const &name)
+    -> std::vector<uint16_t>
+{
+    return this->translate(source, name, nullptr);
+}
+
+auto HackAssembler::assembleObject(std::istream &source, std::string const &name)
+    -> HackObject
+{
+    HackObject object;
+    object.name = name;
+    object.code = this->translate(source, name, &object);
+    object.labels.assign(mLabels.begin(), mLabels.end());
+    // By address, for reproducible object files.
+    std::sort(object.labels.begin(), object.labels.end(), [](auto const &a, auto const &b) {
+        return std::tie(a.second, a.first) < std::tie(b.second, b.first);
+    });
+    return object;
+}
+
+auto HackAssembler::translate(std::istream &source, std::string const &name,
+                              HackObject *object) -> std::vector<uint16_t>
+{
+    // Strip comments and whitespace, keep the source line for errors.
+    std::vector<std::pair<std::string, int>> lines;
+    std::string text;
+    for (int line = 1; std::getline(source, text); line++)
+    {
+        auto comment = text.find("//");
+        if (comment != std::string::npos)
+            text.erase(comment);
+        text.erase(std::remove_if(text.begin(), text.end(), ::isspace), text.end());
+        if (!text.empty())
+            lines.push_back({text, line});
+    }
+    mRemoved = mPeephole ? AsmOptimizer(lines).optimize() : 0;
+
+    auto error = [&](int line, std::string const &message) {
+        return std::runtime_error(name + ":" + std::to_string(line) + ": " + message);
+    };
+
+    // First pass: labels.
+    mSymbols = std::unordered_map<std::string, int>(predefinedSymbols.begin(),
+                                                    predefinedSymbols.end());
+    mLabels.clear();
+    mExternals.clear();
+    mSourceMap = SourceMap();
+    mNextVariable = 16;
+    int address = 0;
+    for (auto &[instruction, line] : lines)
+    {
+        if (instruction.front() != '(')
+        {
+            address++;
+            continue;
+        }
+        if (instruction.back() != ')' || instruction.size() < 3)
+            throw error(line, "malformed label " + instruction);
+        auto label = instruction.substr(1, instruction.size() - 2);
+        if (!mSymbols.emplace(label, address).second)
+            throw error(line, "label " + label + " defined twice");
+        mLabels[label] = address;
+    }
+
+    // Second pass: code.
+    std::vector<uint16_t> rom;
+    for (auto &[instruction, line] : lines)
+    {
+        if (instruction.front() == '(')
+            continue;
+        if (instruction.front() == '@')
+        {
+            auto symbol = instruction.substr(1);
+            if (symbol.empty())
+                throw error(line, "missing A-instruction operand");
+            int value = 0;
+            if (std::isdigit(static_cast<unsigned char>(symbol.front())))
+            {
+                if (symbol.find_first_not_of("0123456789") != std::string::npos ||
+                    symbol.size() > 5 || (value = std::stoi(symbol)) > 32767)
+                    throw error(line, "constant out of range: " + symbol);
+            }
+            else if (object)
+                value = this->relocate(symbol, static_cast<int>(rom.size()), *object);
+            else
+                value = this->resolve(symbol);
+            rom.push_back(static_cast<uint16_t>(value));
+            mSourceMap.add(name, line);
+            continue;
+        }
+
+        // dest=comp;jump
+        uint16_t dest = 0;
+        uint16_t jump = 0;
+        auto comp = instruction;
+        auto eq = comp.find('=');
+        if (eq != std::string::npos)
+        {
+            for (auto c : comp.substr(0, eq))
+            {
+                if (c == 'A')
+                    dest |= 4;
+                else if (c == 'D')
+                    dest |= 2;
+                else if (c == 'M')
+                    dest |= 1;
+                else
+                    throw error(line, "invalid dest in " + instruction);
+            }
+            comp = comp.substr(eq + 1);
+        }
+        auto semicolon = comp.find(';');
+        if (semicolon != std::string::npos)
+        {
+            auto found = jumpBits.find(comp.substr(semicolon + 1));
+            if (found == jumpBits.end())
+                throw error(line, "invalid jump in " + instruction);
+            jump = found->second;
+            comp = comp.substr(0, semicolon);
+        }
+        auto found = compBits.find(comp);
+        if (found == compBits.end())
+            throw error(line, "invalid comp in " + instruction);
+        rom.push_back(static_cast<uint16_t>(0xe000 | found->second << 6 | dest << 3 | jump));
+        mSourceMap.add(name, line);
+    }
+    return rom;
+}
+
+auto HackAssembler::load(std::string const &path) -> std::vector<uint16_t>
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+        throw std::runtime_error("Could not open " + path);
+    return this->assemble(file, path);
+}
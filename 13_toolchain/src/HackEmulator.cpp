@@ -0,0 +1,176 @@
+#include "CPUEmulator.h"
+#include "HackAssembler.h"
+#include "InputScript.h"
+#include "Profiler.h"
+#include "ScriptedRun.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+inline auto same_state(CPUEmulator &cpu, CPUEmulator &reference) -> bool
+{
+    return cpu.a() == reference.a() && cpu.d() == reference.d() &&
+           cpu.pc() == reference.pc() && cpu.cycles() == reference.cycles() &&
+           cpu.halted() == reference.halted() && cpu.ram() == reference.ram();
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        throw std::invalid_argument(
+            "Usage: 'HackEmulator <prog.hack|prog.asm> [-c cycles] [--set addr=value]... "
+            "[--peephole] [--jit] [--verify] [--restore file] [--snapshot file] "
+            "[--screenshot file] [--frames cycles] [--screen-hash] [--input file] [--profile file] [--folded file] "
+            "[--dump addr...]'");
+    }
+
+    std::string path = std::string(argv[1]);
+    uint64_t maxCycles = 10000000;
+    std::vector<std::pair<int, int>> assignments;
+    std::vector<int> dumpAddresses;
+    bool peephole = false;
+    bool jit = false;
+    bool verify = false;
+    std::string profilePath = "";
+    std::string foldedPath = "";
+    std::string restorePath = "";
+    std::string snapshotPath = "";
+    std::string screenshotPath = "";
+    uint64_t frameCycles = 0;
+    bool screenHashes = false;
+    auto input = InputScript();
+    for (int i = 2; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-c" && i + 1 < argc)
+            maxCycles = std::stoull(argv[++i]);
+        else if (arg == "--set" && i + 1 < argc)
+            assignments.push_back(parseAssignment(argv[++i]));
+        else if (arg == "--peephole")
+            peephole = true;
+        else if (arg == "--jit")
+            jit = true;
+        else if (arg == "--verify")
+            verify = jit = true;
+        else if (arg == "--restore" && i + 1 < argc)
+            restorePath = argv[++i];
+        else if (arg == "--snapshot" && i + 1 < argc)
+            snapshotPath = argv[++i];
+        else if (arg == "--screenshot" && i + 1 < argc)
+            screenshotPath = argv[++i];
+        else if (arg == "--frames" && i + 1 < argc)
+            frameCycles = std::stoull(argv[++i]);
+        else if (arg == "--screen-hash")
+            screenHashes = true;
+        else if (arg == "--input" && i + 1 < argc)
+            input.load(argv[++i]);
+        else if (arg == "--profile" && i + 1 < argc)
+            profilePath = argv[++i];
+        else if (arg == "--folded" && i + 1 < argc)
+            foldedPath = argv[++i];
+        else if (arg == "--dump")
+        {
+            // All remaining arguments are addresses.
+            while (i + 1 < argc)
+                dumpAddresses.push_back(std::stoi(argv[++i]));
+        }
+        else
+            throw std::invalid_argument("Unknown option: " + arg);
+    }
+
+    // Assembly is assembled on the fly, its labels name the functions of a profile.
+    auto assembler = HackAssembler();
+    assembler.setPeephole(peephole);
+    auto load = [&](CPUEmulator &emulator) {
+        if (std::filesystem::path(path).extension() == ".asm")
+            emulator.setRom(assembler.load(path));
+        else
+            emulator.load(path);
+        if (!restorePath.empty())
+            emulator.restoreSnapshot(restorePath);
+    };
+
+    auto cpu = CPUEmulator();
+    load(cpu);
+    std::unique_ptr<Profiler> profiler;
+    if (!profilePath.empty() || !foldedPath.empty())
+    {
+        profiler = std::make_unique<Profiler>(assembler.labels(), cpu.rom().size());
+        // .asm lines from the assembler, or from the map next to a .hack file.
+        auto sources = assembler.sourceMap();
+        if (sources.empty() && std::filesystem::exists(path + ".map"))
+            sources.read(path + ".map");
+        profiler->setSources(sources);
+        cpu.setProfiler(profiler.get());
+    }
+    for (auto &[address, value] : assignments)
+        cpu.poke(address, static_cast<int16_t>(value));
+    if (jit && !cpu.setJit(true))
+        std::cerr << "JIT not supported on this host, interpreting" << std::endl;
+
+    auto scriptedRun = ScriptedRun();
+    scriptedRun.setInput(input);
+    scriptedRun.setFrames(frameCycles);
+    scriptedRun.setScreenshot(screenshotPath);
+    scriptedRun.setScreenHashes(screenHashes);
+
+    auto start = std::chrono::steady_clock::now();
+    auto cycles = scriptedRun.run(
+        maxCycles, cpu.ram(), [&](uint64_t budget) { return cpu.run(budget); },
+        [&]() { return cpu.cycles(); });
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+    if (peephole)
+        std::cerr << path << ": " << assembler.removedInstructions()
+                  << " instructions removed, " << cpu.rom().size() << " left" << std::endl;
+    std::cerr << path << ": " << cycles << " cycles"
+              << (cpu.halted() ? ", halted at " : ", stopped at ") << cpu.pc() << " ("
+              << static_cast<uint64_t>(cycles / seconds.count() / 1e6) << " MIPS)"
+              << std::endl;
+    if (!dumpAddresses.empty())
+        cpu.dumpRam(dumpAddresses, std::cout);
+    if (!snapshotPath.empty())
+        cpu.saveSnapshot(snapshotPath);
+
+    if (!profilePath.empty())
+    {
+        std::ofstream out(profilePath);
+        profiler->writeFlat(out);
+        out << std::endl;
+        profiler->writeCallGraph(out);
+    }
+    if (!foldedPath.empty())
+    {
+        std::ofstream out(foldedPath);
+        profiler->writeFolded(out);
+    }
+
+    // Check the translated run against the interpreter.
+    if (verify)
+    {
+        auto reference = CPUEmulator();
+        load(reference);
+        for (auto &[address, value] : assignments)
+            reference.poke(address, static_cast<int16_t>(value));
+        // Replaying the same input, frames do not matter here.
+        auto referenceRun = ScriptedRun();
+        referenceRun.setInput(input);
+        referenceRun.run(
+            maxCycles, reference.ram(), [&](uint64_t budget) { return reference.run(budget); },
+            [&]() { return reference.cycles(); });
+        if (!same_state(cpu, reference))
+        {
+            std::cerr << "Verification failed: interpreter stopped at " << reference.pc()
+                      << " after " << reference.cycles() << " cycles" << std::endl;
+            return 1;
+        }
+        std::cerr << "Verified against the interpreter" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,351 @@
+#include "HackJIT.h"
+#include <cstring>
+#include <stdexcept>
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#define HACK_JIT_SUPPORTED 1
+#endif
+
+// Longest block in Hack instructions and the code space reserved for it.
+inline constexpr int MAX_BLOCK_LENGTH = 64;
+inline constexpr size_t MAX_BLOCK_BYTES = 4096;
+inline constexpr size_t CODE_SIZE = 16 * 1024 * 1024;
+
+HackJIT::HackJIT()
+    : mCode(nullptr), mCodeSize(0), mCodeUsed(0), mRuntimeSize(0), mExitOffset(0), mRom(),
+      mTable(), mBlockLength(), mPendingChains()
+{
+#ifdef HACK_JIT_SUPPORTED
+    void *code = mmap(nullptr, CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (code == MAP_FAILED)
+        return;
+    mCode = static_cast<uint8_t *>(code);
+    mCodeSize = CODE_SIZE;
+    this->emitRuntime();
+#endif
+}
+
+HackJIT::~HackJIT()
+{
+#ifdef HACK_JIT_SUPPORTED
+    if (mCode)
+        munmap(mCode, mCodeSize);
+#endif
+}
+
+auto HackJIT::emit(std::initializer_list<uint8_t> bytes) -> void
+{
+    for (auto byte : bytes)
+        mCode[mCodeUsed++] = byte;
+}
+
+auto HackJIT::emit32(uint32_t value) -> void
+{
+    std::memcpy(mCode + mCodeUsed, &value, 4);
+    mCodeUsed += 4;
+}
+
+auto HackJIT::emitJump(uint8_t const *opcode, size_t opcodeSize, size_t target) -> size_t
+{
+    for (size_t i = 0; i < opcodeSize; i++)
+        mCode[mCodeUsed++] = opcode[i];
+    auto rel32Offset = mCodeUsed;
+    mCodeUsed += 4;
+    this->patch(rel32Offset, target);
+    return rel32Offset;
+}
+
+auto HackJIT::patch(size_t rel32Offset, size_t target) -> void
+{
+    auto rel32 = static_cast<int32_t>(static_cast<int64_t>(target) -
+                                      static_cast<int64_t>(rel32Offset + 4));
+    std::memcpy(mCode + rel32Offset, &rel32, 4);
+}
+
+auto HackJIT::emitRuntime() -> void
+{
+    auto a = static_cast<uint32_t>(offsetof(State, a));
+    auto d = static_cast<uint32_t>(offsetof(State, d));
+    auto remaining = static_cast<uint32_t>(offsetof(State, remaining));
+    auto ram = static_cast<uint32_t>(offsetof(State, ram));
+    auto table = static_cast<uint32_t>(offsetof(State, table));
+
+    // int entry(State *state, void *block)
+    this->emit({0x53, 0x55, 0x41, 0x54, 0x41, 0x55, 0x41, 0x56, 0x41, 0x57}); // push
+    this->emit({0x48, 0x89, 0xfb});                                         // mov rbx, rdi
+    this->emit({0x44, 0x8b, 0xa3});                                         // mov r12d, a
+    this->emit32(a);
+    this->emit({0x44, 0x8b, 0xab}); // mov r13d, d
+    this->emit32(d);
+    this->emit({0x4c, 0x8b, 0xb3}); // mov r14, remaining
+    this->emit32(remaining);
+    this->emit({0x4c, 0x8b, 0xbb}); // mov r15, ram
+    this->emit32(ram);
+    this->emit({0x48, 0x8b, 0xab}); // mov rbp, table
+    this->emit32(table);
+    this->emit({0xff, 0xe6}); // jmp rsi
+
+    // Exit, the status is in eax and the pc already stored.
+    mExitOffset = mCodeUsed;
+    this->emit({0x44, 0x89, 0xa3}); // mov a, r12d
+    this->emit32(a);
+    this->emit({0x44, 0x89, 0xab}); // mov d, r13d
+    this->emit32(d);
+    this->emit({0x4c, 0x89, 0xb3}); // mov remaining, r14
+    this->emit32(remaining);
+    this->emit({0x41, 0x5f, 0x41, 0x5e, 0x41, 0x5d, 0x41, 0x5c, 0x5d, 0x5b, 0xc3}); // pop, ret
+    mRuntimeSize = mCodeUsed;
+}
+
+auto HackJIT::emitExit(uint16_t pc, int status) -> void
+{
+    this->emit({0xc7, 0x83}); // mov dword pc, imm32
+    this->emit32(static_cast<uint32_t>(offsetof(State, pc)));
+    this->emit32(pc);
+    this->emit({0xb8}); // mov eax, status
+    this->emit32(static_cast<uint32_t>(status));
+    uint8_t jmp[] = {0xe9};
+    this->emitJump(jmp, 1, mExitOffset);
+}
+
+auto HackJIT::emitComp(int comp) -> void
+{
+    // The result goes to eax, y (A or M) has been loaded into esi. Only the low
+    // 16 bits matter, 32 bit arithmetic gives the same low bits.
+    auto movD = [this]() { this->emit({0x44, 0x89, 0xe8}); }; // mov eax, r13d
+    auto movY = [this]() { this->emit({0x89, 0xf0}); };       // mov eax, esi
+    switch (comp)
+    {
+    case 0b101010: this->emit({0x31, 0xc0}); break; // 0
+    case 0b111111: this->emit({0xb8, 0x01, 0x00, 0x00, 0x00}); break; // 1
+    case 0b111010: this->emit({0xb8, 0xff, 0xff, 0xff, 0xff}); break; // -1
+    case 0b001100: movD(); break;
+    case 0b110000: movY(); break;
+    case 0b001101: movD(); this->emit({0xf7, 0xd0}); break; // not
+    case 0b110001: movY(); this->emit({0xf7, 0xd0}); break;
+    case 0b001111: movD(); this->emit({0xf7, 0xd8}); break; // neg
+    case 0b110011: movY(); this->emit({0xf7, 0xd8}); break;
+    case 0b011111: movD(); this->emit({0x83, 0xc0, 0x01}); break; // add eax, 1
+    case 0b110111: movY(); this->emit({0x83, 0xc0, 0x01}); break;
+    case 0b001110: movD(); this->emit({0x83, 0xe8, 0x01}); break; // sub eax, 1
+    case 0b110010: movY(); this->emit({0x83, 0xe8, 0x01}); break;
+    case 0b000010: movD(); this->emit({0x01, 0xf0}); break; // add eax, esi
+    case 0b010011: movD(); this->emit({0x29, 0xf0}); break; // sub eax, esi
+    case 0b000111: movY(); this->emit({0x44, 0x29, 0xe8}); break; // sub eax, r13d
+    case 0b000000: movD(); this->emit({0x21, 0xf0}); break; // and eax, esi
+    case 0b010101: movD(); this->emit({0x09, 0xf0}); break; // or eax, esi
+    default: throw std::logic_error("Comp " + std::to_string(comp) + " is not compilable");
+    }
+}
+
+auto HackJIT::isCompilable(uint16_t instruction) -> bool
+{
+    if (!(instruction & 0x8000))
+        return true;
+    switch ((instruction >> 6) & 0x3f)
+    {
+    case 0b101010: case 0b111111: case 0b111010: case 0b001100: case 0b110000:
+    case 0b001101: case 0b110001: case 0b001111: case 0b110011: case 0b011111:
+    case 0b110111: case 0b001110: case 0b110010: case 0b000010: case 0b010011:
+    case 0b000111: case 0b000000: case 0b010101:
+        return true;
+    default:
+        return false;
+    }
+}
+
+auto HackJIT::flush() -> void
+{
+    std::fill(mTable.begin(), mTable.end(), nullptr);
+    std::fill(mBlockLength.begin(), mBlockLength.end(), 0);
+    mPendingChains.clear();
+    mCodeUsed = mRuntimeSize;
+}
+
+auto HackJIT::setRom(std::vector<uint16_t> const &rom) -> void
+{
+    mRom = rom;
+    // Indexed by any 16 bit jump target, targets outside the ROM stay empty.
+    mTable.assign(65536, nullptr);
+    mBlockLength.assign(mRom.size(), 0);
+    if (mCode)
+        this->flush();
+}
+
+auto HackJIT::compile(uint16_t pc) -> bool
+{
+    if (!mCode || pc >= mRom.size())
+        return false;
+    if (mTable[pc])
+        return true;
+
+    // Find the end of the block.
+    int length = 0;
+    size_t end = pc;
+    while (end < mRom.size() && length < MAX_BLOCK_LENGTH && this->isCompilable(mRom[end]))
+    {
+        length++;
+        end++;
+        if ((mRom[end - 1] & 0x8000) && (mRom[end - 1] & 0x07))
+            break;
+    }
+    if (length == 0)
+        return false;
+
+    if (mCodeUsed + MAX_BLOCK_BYTES > mCodeSize)
+        this->flush();
+    auto entry = mCodeUsed;
+
+    // Only run the block if the whole block fits into the cycle budget.
+    this->emit({0x49, 0x81, 0xfe}); // cmp r14, length
+    this->emit32(static_cast<uint32_t>(length));
+    uint8_t jl[] = {0x0f, 0x8c};
+    auto outOfCycles = this->emitJump(jl, 2, 0);
+    this->emit({0x49, 0x81, 0xee}); // sub r14, length
+    this->emit32(static_cast<uint32_t>(length));
+
+    // Chained jumps to blocks that do not exist yet exit through a stub.
+    std::vector<std::pair<size_t, uint16_t>> chains;
+    uint8_t jmp[] = {0xe9};
+    auto chainTo = [&](uint16_t target) {
+        chains.push_back({this->emitJump(jmp, 1, 0), target});
+    };
+
+    int knownA = -1;
+    uint16_t last = static_cast<uint16_t>(end - 1);
+    uint16_t instruction = 0;
+    for (size_t i = pc; i < end; i++)
+    {
+        instruction = mRom[i];
+        if (!(instruction & 0x8000))
+        {
+            this->emit({0x41, 0xbc}); // mov r12d, imm32
+            this->emit32(instruction);
+            knownA = instruction;
+            continue;
+        }
+
+        int comp = (instruction >> 6) & 0x3f;
+        bool usesM = instruction & 0x1000;
+        bool jumps = instruction & 0x07;
+        if (usesM || (instruction & 0x08))
+        {
+            this->emit({0x41, 0x0f, 0xb7, 0xcc});             // movzx ecx, r12w
+            this->emit({0x81, 0xe1, 0xff, 0x7f, 0x00, 0x00}); // and ecx, 0x7fff
+        }
+        // Jumps go to the A before the instruction.
+        if (jumps && knownA < 0)
+            this->emit({0x44, 0x89, 0xe2}); // mov edx, r12d
+        if (usesM)
+            this->emit({0x41, 0x0f, 0xb7, 0x34, 0x4f}); // movzx esi, word [r15+rcx*2]
+        else
+            this->emit({0x44, 0x89, 0xe6}); // mov esi, r12d
+        this->emitComp(comp);
+        if (instruction & 0x08)
+            this->emit({0x66, 0x41, 0x89, 0x04, 0x4f}); // mov [r15+rcx*2], ax
+        if (instruction & 0x20)
+            this->emit({0x41, 0x89, 0xc4}); // mov r12d, eax
+        if (instruction & 0x10)
+            this->emit({0x41, 0x89, 0xc5}); // mov r13d, eax
+        if (jumps)
+            break;
+        if (instruction & 0x20)
+            knownA = -1;
+    }
+
+    bool endsInJump = (instruction & 0x8000) && (instruction & 0x07);
+    if (!endsInJump)
+        chainTo(static_cast<uint16_t>(end));
+    else
+    {
+        int jump = instruction & 0x07;
+        size_t taken = 0;
+        if (jump != 0x07)
+        {
+            // jjj are the lt, eq and gt bits.
+            static const uint8_t conditions[] = {0, 0x8f, 0x84, 0x8d, 0x8c, 0x85, 0x8e};
+            this->emit({0x66, 0x85, 0xc0}); // test ax, ax
+            uint8_t jcc[] = {0x0f, conditions[jump]};
+            taken = this->emitJump(jcc, 2, 0);
+            chainTo(static_cast<uint16_t>(end));
+            this->patch(taken, mCodeUsed);
+        }
+
+        // The same halt idiom the interpreter detects: @L 0;JMP at L, no writes.
+        bool mayHalt = last > 0 && (instruction & 0x38) == 0 && mRom[last - 1] == last - 1;
+        if (knownA >= 0)
+        {
+            if (mayHalt && knownA == last - 1)
+                this->emitExit(static_cast<uint16_t>(knownA), 1);
+            else
+                chainTo(static_cast<uint16_t>(knownA));
+        }
+        else
+        {
+            this->emit({0x0f, 0xb7, 0xc2}); // movzx eax, dx
+            size_t halts = 0;
+            if (mayHalt)
+            {
+                this->emit({0x3d}); // cmp eax, last - 1
+                this->emit32(last - 1u);
+                uint8_t je[] = {0x0f, 0x84};
+                halts = this->emitJump(je, 2, 0);
+            }
+            this->emit({0x48, 0x8b, 0x44, 0xc5, 0x00}); // mov rax, [rbp+rax*8]
+            this->emit({0x48, 0x85, 0xc0});             // test rax, rax
+            uint8_t jz[] = {0x0f, 0x84};
+            auto notCompiled = this->emitJump(jz, 2, 0);
+            this->emit({0xff, 0xe0}); // jmp rax
+
+            this->patch(notCompiled, mCodeUsed);
+            this->emit({0x0f, 0xb7, 0xc2}); // movzx eax, dx
+            this->emit({0x89, 0x83});       // mov pc, eax
+            this->emit32(static_cast<uint32_t>(offsetof(State, pc)));
+            this->emit({0x31, 0xc0}); // xor eax, eax
+            this->emitJump(jmp, 1, mExitOffset);
+            if (mayHalt)
+            {
+                this->patch(halts, mCodeUsed);
+                this->emitExit(static_cast<uint16_t>(last - 1), 1);
+            }
+        }
+    }
+
+    this->patch(outOfCycles, mCodeUsed);
+    this->emitExit(pc, 0);
+
+    // Chain to compiled blocks directly, the others through an exit stub that is
+    // patched once the target gets compiled.
+    for (auto &[rel32Offset, target] : chains)
+    {
+        if (target < mRom.size() && mTable[target])
+            this->patch(rel32Offset, static_cast<uint8_t *>(mTable[target]) - mCode);
+        else
+        {
+            this->patch(rel32Offset, mCodeUsed);
+            this->emitExit(target, 0);
+            if (target < mRom.size())
+                mPendingChains[target].push_back(rel32Offset);
+        }
+    }
+
+    mTable[pc] = mCode + entry;
+    mBlockLength[pc] = length;
+    auto pending = mPendingChains.find(pc);
+    if (pending != mPendingChains.end())
+    {
+        for (auto rel32Offset : pending->second)
+            this->patch(rel32Offset, entry);
+        mPendingChains.erase(pending);
+    }
+    return true;
+}
+
+auto HackJIT::execute(State &state) -> bool
+{
+    using Entry = int (*)(State *, void *);
+    state.table = mTable.data();
+    auto entry = reinterpret_cast<Entry>(mCode);
+    return entry(&state, mTable[state.pc]) == 1;
+}
@@ -0,0 +1,146 @@
+#include "HackAssembler.h"
+#include "HackObject.h"
+#include "ObjectLinker.h"
+#include <algorithm>
+#include <bitset>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+inline auto build_output_path(std::string const &inPath) -> std::string
+{
+    auto path = std::filesystem::path(inPath);
+    if (path.has_extension())
+        return path.replace_extension(".hack").string();
+    // Directory: dir/dir.hack
+    if (path.filename().empty())
+        path = path.parent_path();
+    return (path / path.filename()).string() + ".hack";
+}
+
+// The object of an .asm file, reassembled only if the source is newer than
+// the cached object in cacheDir, or next to the source without one. Optimized
+// objects are cached apart, as X.peephole.hobj.
+inline auto object_for(std::string const &asmPath, std::string const &cacheDir,
+                       bool peephole, HackAssembler &assembler, int &assembled)
+    -> HackObject
+{
+    auto source = std::filesystem::path(asmPath);
+    auto dir = cacheDir.empty() ? source.parent_path() : std::filesystem::path(cacheDir);
+    auto objectPath = dir / source.filename().replace_extension(
+                                peephole ? ".peephole.hobj" : ".hobj");
+    HackObject object;
+    if (std::filesystem::exists(objectPath) &&
+        std::filesystem::last_write_time(objectPath) >=
+            std::filesystem::last_write_time(source))
+    {
+        object.read(objectPath.string());
+        return object;
+    }
+    std::ifstream file(asmPath);
+    if (!file.is_open())
+        throw std::runtime_error("Could not open " + asmPath);
+    object = assembler.assembleObject(file, source.filename().string());
+    object.write(objectPath.string());
+    assembled++;
+    return object;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        throw std::invalid_argument(
+            "Usage: 'HackLinker <file.asm|file.hobj|dir>... [-o out.hack] [--cache dir] "
+            "[--peephole]'");
+    }
+
+    std::vector<std::string> inputs;
+    std::string outputPath = "";
+    std::string cacheDir = "";
+    bool peephole = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc)
+            outputPath = argv[++i];
+        else if (arg == "--cache" && i + 1 < argc)
+            cacheDir = argv[++i];
+        else if (arg == "--peephole")
+            peephole = true;
+        else if (arg.starts_with("-"))
+            throw std::invalid_argument("Unknown option: " + arg);
+        else
+            inputs.push_back(arg);
+    }
+    if (inputs.empty())
+        throw std::invalid_argument("No input files");
+    if (outputPath.empty())
+        outputPath = build_output_path(inputs.front());
+    if (!cacheDir.empty())
+        std::filesystem::create_directories(cacheDir);
+
+    // Directories contribute their .asm files, or their objects if they have none.
+    std::vector<std::string> paths;
+    for (auto &input : inputs)
+    {
+        if (!std::filesystem::is_directory(input))
+        {
+            paths.push_back(input);
+            continue;
+        }
+        std::vector<std::string> sources;
+        std::vector<std::string> objects;
+        for (auto const &dirEntry : std::filesystem::directory_iterator(input))
+        {
+            auto extension = dirEntry.path().extension();
+            if (extension == ".asm")
+                sources.push_back(dirEntry.path().string());
+            else if (extension == ".hobj" &&
+                     (dirEntry.path().stem().extension() == ".peephole") == peephole)
+                objects.push_back(dirEntry.path().string());
+        }
+        auto &found = sources.empty() ? objects : sources;
+        std::sort(found.begin(), found.end());
+        paths.insert(paths.end(), found.begin(), found.end());
+    }
+    // The bootstrap code of VMTranslator --split starts the program.
+    std::stable_partition(paths.begin(), paths.end(), [](std::string const &path) {
+        return std::filesystem::path(path).filename().string().starts_with("Bootstrap.");
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    auto assembler = HackAssembler();
+    assembler.setPeephole(peephole);
+    auto linker = ObjectLinker();
+    int assembled = 0;
+    for (auto &path : paths)
+    {
+        if (std::filesystem::path(path).extension() == ".hobj")
+        {
+            HackObject object;
+            object.read(path);
+            linker.add(std::move(object));
+        }
+        else
+            linker.add(object_for(path, cacheDir, peephole, assembler, assembled));
+    }
+    auto rom = linker.link();
+
+    std::ofstream out(outputPath);
+    if (!out.is_open())
+        throw std::runtime_error("Could not open " + outputPath);
+    for (auto word : rom)
+        out << std::bitset<16>(word) << "\n";
+    out.close();
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+    std::cout << outputPath << ": " << paths.size() << " objects, " << assembled
+              << " assembled, " << rom.size() << " words ("
+              << static_cast<int>(seconds.count() * 1000) << " ms)" << std::endl;
+    return 0;
+}
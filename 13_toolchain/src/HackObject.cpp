@@ -0,0 +1,125 @@
+#include "HackObject.h"
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+inline auto put_u32(std::string &out, uint32_t value) -> void
+{
+    for (int shift = 0; shift < 32; shift += 8)
+        out.push_back(static_cast<char>(value >> shift));
+}
+
+inline auto put_string(std::string &out, std::string const &value) -> void
+{
+    put_u32(out, static_cast<uint32_t>(value.size()));
+    out += value;
+}
+
+auto HackObject::write(std::string const &path) const -> void
+{
+    std::string out = "HOB1";
+    put_string(out, name);
+    put_u32(out, static_cast<uint32_t>(code.size()));
+    for (auto word : code)
+    {
+        out.push_back(static_cast<char>(word));
+        out.push_back(static_cast<char>(word >> 8));
+    }
+    put_u32(out, static_cast<uint32_t>(labels.size()));
+    for (auto &[label, offset] : labels)
+    {
+        put_string(out, label);
+        put_u32(out, static_cast<uint32_t>(offset));
+    }
+    put_u32(out, static_cast<uint32_t>(localRelocations.size()));
+    for (auto address : localRelocations)
+        put_u32(out, address);
+    put_u32(out, static_cast<uint32_t>(externals.size()));
+    for (auto &external : externals)
+        put_string(out, external);
+    put_u32(out, static_cast<uint32_t>(externalRelocations.size()));
+    for (auto &[address, index] : externalRelocations)
+    {
+        put_u32(out, address);
+        put_u32(out, static_cast<uint32_t>(index));
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("Could not open " + path);
+    file << out;
+}
+
+auto HackObject::read(std::string const &path) -> void
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("Could not open " + path);
+    std::string content{std::istreambuf_iterator<char>(file),
+                        std::istreambuf_iterator<char>()};
+    if (content.compare(0, 4, "HOB1") != 0)
+        throw std::runtime_error(path + ": not a Hack object file");
+
+    size_t pos = 4;
+    auto need = [&](size_t bytes) {
+        if (content.size() - pos < bytes)
+            throw std::runtime_error(path + ": truncated object file");
+    };
+    auto u32 = [&]() -> uint32_t {
+        need(4);
+        uint32_t value = 0;
+        for (int shift = 0; shift < 32; shift += 8)
+            value |= static_cast<uint32_t>(static_cast<uint8_t>(content[pos++])) << shift;
+        return value;
+    };
+    auto string = [&]() -> std::string {
+        auto length = u32();
+        need(length);
+        pos += length;
+        return content.substr(pos - length, length);
+    };
+    // Offsets and indices must lie below end, counts are bounded by the remaining bytes.
+    auto below = [&](uint64_t end) -> uint32_t {
+        auto value = u32();
+        if (value >= end)
+            throw std::runtime_error(path + ": offset out of range");
+        return value;
+    };
+    auto count = [&](size_t bytesEach) -> uint32_t {
+        auto value = u32();
+        need(static_cast<size_t>(value) * bytesEach);
+        return value;
+    };
+
+    name = string();
+    code.resize(count(2));
+    if (code.size() > 32768)
+        throw std::runtime_error(path + ": code does not fit into the ROM");
+    for (auto &word : code)
+    {
+        word = static_cast<uint16_t>(static_cast<uint8_t>(content[pos]) |
+                                     static_cast<uint8_t>(content[pos + 1]) << 8);
+        pos += 2;
+    }
+    auto size = static_cast<uint32_t>(code.size());
+    labels.resize(count(8));
+    for (auto &[label, labelOffset] : labels)
+    {
+        label = string();
+        labelOffset = static_cast<int>(below(size + 1ull));
+    }
+    localRelocations.resize(count(4));
+    for (auto &address : localRelocations)
+        address = static_cast<uint16_t>(below(size));
+    externals.resize(count(4));
+    for (auto &external : externals)
+        external = string();
+    externalRelocations.resize(count(8));
+    for (auto &[address, index] : externalRelocations)
+    {
+        address = static_cast<uint16_t>(below(size));
+        index = static_cast<int>(below(externals.size()));
+    }
+    if (pos != content.size())
+        throw std::runtime_error(path + ": trailing bytes in object file");
+}
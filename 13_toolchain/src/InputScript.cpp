@@ -0,0 +1,76 @@
+#include "InputScript.h"
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+// Key codes of the Hack keyboard.
+inline const std::map<std::string, int> keyNames{
+    {"space", 32},     {"newline", 128}, {"backspace", 129}, {"left", 130},
+    {"up", 131},       {"right", 132},   {"down", 133},      {"home", 134},
+    {"end", 135},      {"pageup", 136},  {"pagedown", 137},  {"insert", 138},
+    {"delete", 139},   {"esc", 140},     {"release", 0},
+};
+
+auto InputScript::load(std::string const &path) -> void
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+        throw std::runtime_error("Could not open " + path);
+
+    mEvents.clear();
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        lineNumber++;
+        line = line.substr(0, line.find("//"));
+        std::istringstream words(line);
+        std::string cycle, key, rest;
+        if (!(words >> cycle))
+            continue;
+        auto where = path + ":" + std::to_string(lineNumber) + ": ";
+        if (!(words >> key) || (words >> rest) ||
+            !std::all_of(cycle.begin(), cycle.end(), ::isdigit))
+            throw std::runtime_error(where + "expected 'cycle key', got " + line);
+
+        int code = -1;
+        auto name = key;
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        if (key.size() == 1)
+            code = static_cast<unsigned char>(key[0]);
+        else if (keyNames.count(name))
+            code = keyNames.at(name);
+        else if (name[0] == 'f' && name.size() <= 3 &&
+                 std::all_of(name.begin() + 1, name.end(), ::isdigit) &&
+                 std::stoi(name.substr(1)) >= 1 && std::stoi(name.substr(1)) <= 12)
+            code = 140 + std::stoi(name.substr(1));
+        else if (key[0] == '#' && key.size() > 1 &&
+                 std::all_of(key.begin() + 1, key.end(), ::isdigit) && key.size() <= 6)
+            code = std::stoi(key.substr(1));
+        if (code < 0 || code > 32767)
+            throw std::runtime_error(where + "unknown key " + key);
+
+        auto event = KeyEvent{std::stoull(cycle), static_cast<int16_t>(code)};
+        if (!mEvents.empty() && event.cycle < mEvents.back().cycle)
+            throw std::runtime_error(where + "events must be in increasing order of cycles");
+        mEvents.push_back(event);
+    }
+}
+
+auto InputScript::keyAt(uint64_t cycle) -> int16_t
+{
+    auto next = std::upper_bound(mEvents.begin(), mEvents.end(), cycle,
+                                 [](uint64_t c, KeyEvent const &e) { return c < e.cycle; });
+    return next == mEvents.begin() ? 0 : std::prev(next)->key;
+}
+
+auto InputScript::nextEvent(uint64_t cycle) -> uint64_t
+{
+    auto next = std::upper_bound(mEvents.begin(), mEvents.end(), cycle,
+                                 [](uint64_t c, KeyEvent const &e) { return c < e.cycle; });
+    return next == mEvents.end() ? std::numeric_limits<uint64_t>::max() : next->cycle;
+}
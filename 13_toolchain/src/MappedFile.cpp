@@ -0,0 +1,55 @@
+#include "MappedFile.h"
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAVE_MMAP
+#endif
+
+MappedFile::MappedFile(std::string const &path) : mData(nullptr), mSize(0), mBuffer()
+{
+#ifdef HAVE_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Could not open " + path);
+    struct stat status;
+    if (fstat(fd, &status) != 0)
+    {
+        close(fd);
+        throw std::runtime_error("Could not open " + path);
+    }
+    // Empty files cannot be mapped, they have no data anyway.
+    if (status.st_size > 0)
+    {
+        void *mapped = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ,
+                            MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED)
+        {
+            close(fd);
+            throw std::runtime_error("Could not map " + path);
+        }
+        mData = static_cast<char const *>(mapped);
+        mSize = static_cast<size_t>(status.st_size);
+    }
+    close(fd);
+#else
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("Could not open " + path);
+    mBuffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    mData = mBuffer.data();
+    mSize = mBuffer.size();
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef HAVE_MMAP
+    if (mData != nullptr)
+        munmap(const_cast<char *>(mData), mSize);
+#endif
+}
@@ -0,0 +1,79 @@
+#include "NativeOS.h"
+#include "definitions.h"
+#include <cmath>
+
+inline auto native_abs(int16_t const *args, int16_t *, int16_t &result) -> bool
+{
+    result = static_cast<int16_t>(args[0] < 0 ? -args[0] : args[0]);
+    return true;
+}
+
+inline auto native_multiply(int16_t const *args, int16_t *, int16_t &result) -> bool
+{
+    // Shift and add keeps the low 16 bits of the product.
+    result = static_cast<int16_t>(static_cast<uint16_t>(args[0]) *
+                                  static_cast<uint16_t>(args[1]));
+    return true;
+}
+
+inline auto native_divide(int16_t const *args, int16_t *, int16_t &result) -> bool
+{
+    // -32768 has no absolute value to divide.
+    if (args[1] == 0 || args[0] == INT16_MIN || args[1] == INT16_MIN)
+        return false;
+    result = static_cast<int16_t>(args[0] / args[1]);
+    return true;
+}
+
+inline auto native_min(int16_t const *args, int16_t *, int16_t &result) -> bool
+{
+    result = args[0] < args[1] ? args[0] : args[1];
+    return true;
+}
+
+inline auto native_max(int16_t const *args, int16_t *, int16_t &result) -> bool
+{
+    result = args[0] > args[1] ? args[0] : args[1];
+    return true;
+}
+
+inline auto native_sqrt(int16_t const *args, int16_t *, int16_t &result) -> bool
+{
+    if (args[0] < 0)
+        return false;
+    result = static_cast<int16_t>(std::sqrt(static_cast<double>(args[0])));
+    return true;
+}
+
+inline auto native_peek(int16_t const *args, int16_t *ram, int16_t &result) -> bool
+{
+    result = ram[args[0] & (RAM_SIZE - 1)];
+    return true;
+}
+
+inline auto native_poke(int16_t const *args, int16_t *ram, int16_t &result) -> bool
+{
+    ram[args[0] & (RAM_SIZE - 1)] = args[1];
+    result = 0;
+    return true;
+}
+
+auto nativeFunctions() -> std::vector<NativeFunction> const &
+{
+    static const std::vector<NativeFunction> functions{
+        {"Math.abs", 1, native_abs},       {"Math.multiply", 2, native_multiply},
+        {"Math.divide", 2, native_divide}, {"Math.min", 2, native_min},
+        {"Math.max", 2, native_max},       {"Math.sqrt", 1, native_sqrt},
+        {"Memory.peek", 1, native_peek},   {"Memory.poke", 2, native_poke},
+    };
+    return functions;
+}
+
+auto findNative(std::string const &name, int nArgs) -> int
+{
+    auto &functions = nativeFunctions();
+    for (size_t i = 0; i < functions.size(); i++)
+        if (functions[i].name == name && functions[i].nArgs == nArgs)
+            return static_cast<int>(i);
+    return -1;
+}
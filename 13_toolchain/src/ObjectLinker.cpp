@@ -0,0 +1,57 @@
+#include "ObjectLinker.h"
+#include "definitions.h"
+#include <stdexcept>
+
+auto ObjectLinker::add(HackObject object) -> void
+{
+    mBases.push_back(mSize);
+    mSize += static_cast<int>(object.code.size());
+    mObjects.push_back(std::move(object));
+}
+
+auto ObjectLinker::link() -> std::vector<uint16_t>
+{
+    if (mSize > ROM_SIZE)
+        throw std::runtime_error("Program of " + std::to_string(mSize) +
+                                 " words does not fit into the ROM");
+
+    mLabels.clear();
+    for (size_t i = 0; i < mObjects.size(); i++)
+        for (auto &[label, offset] : mObjects[i].labels)
+            if (!mLabels.emplace(label, mBases[i] + offset).second)
+                throw std::runtime_error(mObjects[i].name + ": label " + label +
+                                         " is already defined by another object");
+
+    std::vector<uint16_t> rom;
+    rom.reserve(mSize);
+    std::unordered_map<std::string, int> variables;
+    int nextVariable = 16;
+    for (size_t i = 0; i < mObjects.size(); i++)
+    {
+        auto &object = mObjects[i];
+        auto base = mBases[i];
+        rom.insert(rom.end(), object.code.begin(), object.code.end());
+        for (auto address : object.localRelocations)
+            rom[base + address] = static_cast<uint16_t>(rom[base + address] + base);
+
+        // Externals in order of first use, the variables among them are the
+        // object's static section.
+        std::vector<int> values;
+        for (auto &external : object.externals)
+        {
+            auto label = mLabels.find(external);
+            if (label != mLabels.end())
+                values.push_back(label->second);
+            else
+            {
+                auto variable = variables.emplace(external, nextVariable);
+                if (variable.second)
+                    nextVariable++;
+                values.push_back(variable.first->second);
+            }
+        }
+        for (auto &[address, index] : object.externalRelocations)
+            rom[base + address] = static_cast<uint16_t>(values[index]);
+    }
+    return rom;
+}
@@ -0,0 +1,208 @@
+#include "Profiler.h"
+#include <algorithm>
+#include <iomanip>
+
+Profiler::Profiler(std::vector<std::string> functionNames, std::vector<int> functionOf)
+    : mFunctionNames{"(start)"}, mFunctionOf(), mIsEntry(), mIsReturn(),
+      mCounts(functionOf.size() + 1, 0), mTaken(functionOf.size() + 1, 0), mLast(-1),
+      mCycles(0), mStack(), mEntryCycles(), mSampledCycles(0), mStackCycles(), mCalls(),
+      mTotals(), mSources()
+{
+    mFunctionNames.insert(mFunctionNames.end(), functionNames.begin(), functionNames.end());
+    // One more address for programs that end by running past the last instruction.
+    for (auto function : functionOf)
+        mFunctionOf.push_back(function + 1);
+    mFunctionOf.push_back(0);
+    mIsEntry.assign(mFunctionOf.size(), false);
+    mIsReturn.assign(mFunctionOf.size(), false);
+    mTotals.assign(mFunctionNames.size(), CallCount{0, 0});
+}
+
+Profiler::Profiler(std::unordered_map<std::string, int> const &labels, size_t codeSize)
+    : mFunctionNames{"(start)"}, mFunctionOf(codeSize + 1, 0), mIsEntry(codeSize + 1, false),
+      mIsReturn(codeSize + 1, false), mCounts(codeSize + 1, 0), mTaken(codeSize + 1, 0),
+      mLast(-1), mCycles(0), mStack(), mEntryCycles(), mSampledCycles(0), mStackCycles(),
+      mCalls(), mTotals(), mSources()
+{
+    std::vector<std::pair<int, std::string>> entries;
+    for (auto &[label, address] : labels)
+    {
+        if (address < 0 || static_cast<size_t>(address) > codeSize)
+            continue;
+        // Shared routines such as $CALL are listed on their own, but are
+        // jumped to without a call.
+        bool isRoutine = label.front() == '$' && label.find('$', 1) == std::string::npos;
+        if (isRoutine ||
+            (label.find('.') != std::string::npos && label.find('$') == std::string::npos))
+            entries.push_back({address, label});
+        else if (label.find("$ret.") != std::string::npos)
+            mIsReturn[address] = true;
+    }
+
+    // A function reaches up to the next one.
+    std::sort(entries.begin(), entries.end());
+    for (auto &[address, name] : entries)
+    {
+        mFunctionNames.push_back(name);
+        mIsEntry[address] = name.front() != '$';
+        std::fill(mFunctionOf.begin() + address, mFunctionOf.end(),
+                  static_cast<int>(mFunctionNames.size()) - 1);
+    }
+    mTotals.assign(mFunctionNames.size(), CallCount{0, 0});
+}
+
+auto Profiler::sample() -> void
+{
+    if (mCycles > mSampledCycles && !mStack.empty())
+        mStackCycles[mStack] += mCycles - mSampledCycles;
+    mSampledCycles = mCycles;
+}
+
+auto Profiler::close(size_t depth, uint64_t until,
+                     std::map<std::pair<int, int>, CallCount> &calls,
+                     std::vector<CallCount> &totals) -> void
+{
+    // Recursive frames are already covered by the outermost one.
+    int function = mStack[depth];
+    if (std::find(mStack.begin(), mStack.begin() + depth, function) != mStack.begin() + depth)
+        return;
+    auto elapsed = until - mEntryCycles[depth];
+    totals[function].cycles += elapsed;
+    if (depth > 0)
+        calls[{mStack[depth - 1], function}].cycles += elapsed;
+}
+
+auto Profiler::call(int entry) -> void
+{
+    this->sample();
+    int function = mFunctionOf[entry];
+    if (!mStack.empty())
+        mCalls[{mStack.back(), function}].calls++;
+    mTotals[function].calls++;
+    mStack.push_back(function);
+    mEntryCycles.push_back(mCycles);
+}
+
+auto Profiler::ret() -> void
+{
+    this->sample();
+    // Returns from the outermost frame, e.g. of test scripts that set up
+    // a fake caller, leave it in place.
+    if (mStack.size() < 2)
+        return;
+    this->close(mStack.size() - 1, mCycles, mCalls, mTotals);
+    mStack.pop_back();
+    mEntryCycles.pop_back();
+}
+
+auto Profiler::writeFlat(std::ostream &out, int addresses) -> void
+{
+    std::vector<uint64_t> self(mFunctionNames.size(), 0);
+    for (size_t address = 0; address < mCounts.size(); address++)
+        self[mFunctionOf[address]] += mCounts[address];
+
+    // Frames still open count up to now.
+    auto calls = mCalls;
+    auto totals = mTotals;
+    for (size_t depth = mStack.size(); depth-- > 0;)
+        this->close(depth, mCycles, calls, totals);
+
+    std::vector<int> order;
+    for (size_t function = 0; function < mFunctionNames.size(); function++)
+        if (self[function] > 0 || totals[function].calls > 0)
+            order.push_back(static_cast<int>(function));
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return self[a] > self[b]; });
+
+    auto percent = [&](uint64_t cycles) {
+        return mCycles == 0 ? 0.0 : 100.0 * static_cast<double>(cycles) / mCycles;
+    };
+    out << "Flat profile, " << mCycles << " instructions" << std::endl << std::endl;
+    out << "  self %        self     total %       calls  function" << std::endl;
+    out << std::fixed << std::setprecision(2);
+    for (auto function : order)
+        out << std::setw(8) << percent(self[function]) << std::setw(12) << self[function]
+            << std::setw(10) << percent(totals[function].cycles) << std::setw(12)
+            << totals[function].calls << "  " << mFunctionNames[function] << std::endl;
+
+    std::vector<int> hottest;
+    for (size_t address = 0; address < mCounts.size(); address++)
+        if (mCounts[address] > 0)
+            hottest.push_back(static_cast<int>(address));
+    std::sort(hottest.begin(), hottest.end(),
+              [&](int a, int b) { return mCounts[a] > mCounts[b]; });
+    if (hottest.size() > static_cast<size_t>(addresses))
+        hottest.resize(addresses);
+
+    out << std::endl << "Hottest addresses" << std::endl << std::endl;
+    out << " address       count  function" << std::endl;
+    for (auto address : hottest)
+        out << std::setw(8) << address << std::setw(12) << mCounts[address] << "  "
+            << mFunctionNames[mFunctionOf[address]] << std::endl;
+
+    if (!mSources.empty())
+    {
+        std::map<std::pair<int, int>, uint64_t> lineCounts;
+        for (size_t address = 0; address < mCounts.size(); address++)
+        {
+            auto location = mSources.at(address);
+            if (mCounts[address] > 0 && location.line > 0)
+                lineCounts[{location.file, location.line}] += mCounts[address];
+        }
+        std::vector<std::pair<uint64_t, std::pair<int, int>>> lines;
+        for (auto &[location, count] : lineCounts)
+            lines.push_back({count, location});
+        std::sort(lines.rbegin(), lines.rend());
+        if (lines.size() > static_cast<size_t>(addresses))
+            lines.resize(addresses);
+
+        if (!lines.empty())
+            out << std::endl << "Hottest source lines" << std::endl << std::endl
+                << "  self %       count  line" << std::endl;
+        for (auto &[count, location] : lines)
+            out << std::setw(8) << percent(count) << std::setw(12) << count << "  "
+                << mSources.files()[location.first] << ":" << location.second << std::endl;
+    }
+    out << std::defaultfloat;
+}
+
+auto Profiler::writeCallGraph(std::ostream &out) -> void
+{
+    auto calls = mCalls;
+    auto totals = mTotals;
+    for (size_t depth = mStack.size(); depth-- > 0;)
+        this->close(depth, mCycles, calls, totals);
+
+    std::vector<int> order;
+    for (size_t function = 0; function < mFunctionNames.size(); function++)
+        if (totals[function].cycles > 0 || totals[function].calls > 0)
+            order.push_back(static_cast<int>(function));
+    std::sort(order.begin(), order.end(),
+              [&](int a, int b) { return totals[a].cycles > totals[b].cycles; });
+
+    out << "Call graph, inclusive instructions per call edge" << std::endl;
+    for (auto function : order)
+    {
+        out << std::endl
+            << mFunctionNames[function] << ": " << totals[function].cycles
+            << " instructions, " << totals[function].calls << " calls" << std::endl;
+        for (auto &[edge, count] : calls)
+            if (edge.second == function)
+                out << "    called by " << mFunctionNames[edge.first] << " " << count.calls
+                    << " times" << std::endl;
+        for (auto &[edge, count] : calls)
+            if (edge.first == function)
+                out << "    calls " << mFunctionNames[edge.second] << " " << count.calls
+                    << " times, " << count.cycles << " instructions" << std::endl;
+    }
+}
+
+auto Profiler::writeFolded(std::ostream &out) -> void
+{
+    this->sample();
+    for (auto &[stack, cycles] : mStackCycles)
+    {
+        for (size_t i = 0; i < stack.size(); i++)
+            out << (i > 0 ? ";" : "") << mFunctionNames[stack[i]];
+        out << " " << cycles << std::endl;
+    }
+}
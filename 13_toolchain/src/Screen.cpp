@@ -0,0 +1,169 @@
+#include "Screen.h"
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+inline constexpr int ROW_BYTES = SCREEN_WIDTH / 8;
+
+inline auto reverse_bits(uint8_t byte) -> uint8_t
+{
+    byte = static_cast<uint8_t>((byte & 0xf0) >> 4 | (byte & 0x0f) << 4);
+    byte = static_cast<uint8_t>((byte & 0xcc) >> 2 | (byte & 0x33) << 2);
+    return static_cast<uint8_t>((byte & 0xaa) >> 1 | (byte & 0x55) << 1);
+}
+
+auto packScreen(int16_t const *screen, uint8_t *rows) -> void
+{
+    // Little endian words already put the bytes in pixel order, only the bits
+    // of each byte are reversed.
+    auto bytes = reinterpret_cast<uint8_t const *>(screen);
+    int size = SCREEN_WORDS * 2;
+    int i = 0;
+#if defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__))
+    // The scalar swaps of nibbles, pairs and bits, 16 bytes at a time. The
+    // shifts work on 16 bit lanes, the masks keep bits from crossing bytes.
+    const __m128i nibbles = _mm_set1_epi8(0x0f);
+    const __m128i pairs = _mm_set1_epi8(0x33);
+    const __m128i bits = _mm_set1_epi8(0x55);
+    for (; i + 16 <= size; i += 16)
+    {
+        auto x = _mm_loadu_si128(reinterpret_cast<__m128i const *>(bytes + i));
+        x = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 4), nibbles),
+                         _mm_slli_epi16(_mm_and_si128(x, nibbles), 4));
+        x = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 2), pairs),
+                         _mm_slli_epi16(_mm_and_si128(x, pairs), 2));
+        x = _mm_or_si128(_mm_and_si128(_mm_srli_epi16(x, 1), bits),
+                         _mm_slli_epi16(_mm_and_si128(x, bits), 1));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(rows + i), x);
+    }
+#endif
+    for (; i < size; i += 2)
+    {
+        auto word = static_cast<uint16_t>(screen[i / 2]);
+        rows[i] = reverse_bits(static_cast<uint8_t>(word));
+        rows[i + 1] = reverse_bits(static_cast<uint8_t>(word >> 8));
+    }
+}
+
+auto screenHash(int16_t const *screen) -> uint64_t
+{
+    // FNV-1a on 64 bit blocks.
+    uint64_t hash = 14695981039346656037ull;
+    for (int i = 0; i < SCREEN_WORDS; i += 4)
+    {
+        uint64_t block;
+        std::memcpy(&block, screen + i, sizeof(block));
+        hash = (hash ^ block) * 1099511628211ull;
+    }
+    return hash ^ (hash >> 29);
+}
+
+inline auto crc32(std::string const &data, size_t begin) -> uint32_t
+{
+    static const auto table = [] {
+        std::array<uint32_t, 256> table{};
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        return table;
+    }();
+    uint32_t crc = 0xffffffffu;
+    for (size_t i = begin; i < data.size(); i++)
+        crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xff] ^ (crc >> 8);
+    return crc ^ 0xffffffffu;
+}
+
+inline auto append_be32(std::string &out, uint32_t value) -> void
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back(static_cast<char>(value >> shift));
+}
+
+inline auto append_chunk(std::string &out, char const *type, std::string const &data) -> void
+{
+    append_be32(out, static_cast<uint32_t>(data.size()));
+    auto start = out.size();
+    out.append(type, 4);
+    out += data;
+    append_be32(out, crc32(out, start));
+}
+
+// PNG with the rows in stored, uncompressed deflate blocks. A frame is 16 KB
+// either way and this needs no zlib.
+inline auto encode_png(uint8_t const *rows) -> std::string
+{
+    std::string raw;
+    for (int y = 0; y < SCREEN_HEIGHT; y++)
+    {
+        raw.push_back(0); // Filter type none
+        // Grayscale 0 is black.
+        for (int x = 0; x < ROW_BYTES; x++)
+            raw.push_back(static_cast<char>(~rows[y * ROW_BYTES + x]));
+    }
+
+    std::string zlib = "\x78\x01";
+    for (size_t pos = 0; pos < raw.size(); pos += 65535)
+    {
+        auto length = std::min<size_t>(65535, raw.size() - pos);
+        zlib.push_back(pos + length == raw.size() ? 1 : 0);
+        zlib.push_back(static_cast<char>(length & 0xff));
+        zlib.push_back(static_cast<char>(length >> 8));
+        zlib.push_back(static_cast<char>(~length & 0xff));
+        zlib.push_back(static_cast<char>((~length >> 8) & 0xff));
+        zlib.append(raw, pos, length);
+    }
+    uint32_t a = 1, b = 0;
+    for (auto c : raw)
+    {
+        a = (a + static_cast<uint8_t>(c)) % 65521;
+        b = (b + a) % 65521;
+    }
+    append_be32(zlib, b << 16 | a);
+
+    std::string header;
+    append_be32(header, SCREEN_WIDTH);
+    append_be32(header, SCREEN_HEIGHT);
+    header += std::string("\x01\x00\x00\x00\x00", 5); // 1 bit grayscale
+
+    std::string png = "\x89PNG\r\n\x1a\n";
+    append_chunk(png, "IHDR", header);
+    append_chunk(png, "IDAT", zlib);
+    append_chunk(png, "IEND", "");
+    return png;
+}
+
+auto framePath(std::string const &path, int frame) -> std::string
+{
+    auto number = std::to_string(frame);
+    number.insert(0, number.size() < 5 ? 5 - number.size() : 0, '0');
+    auto dot = path.rfind('.');
+    if (dot == std::string::npos || path.find('/', dot) != std::string::npos)
+        return path + "." + number;
+    return path.substr(0, dot) + "." + number + path.substr(dot);
+}
+
+auto writeScreen(std::string const &path, int16_t const *screen) -> void
+{
+    std::vector<uint8_t> rows(SCREEN_WORDS * 2);
+    packScreen(screen, rows.data());
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("Could not open " + path);
+    if (path.size() >= 4 && path.compare(path.size() - 4, 4, ".png") == 0)
+        file << encode_png(rows.data());
+    else
+    {
+        file << "P4\n" << SCREEN_WIDTH << " " << SCREEN_HEIGHT << "\n";
+        file.write(reinterpret_cast<char const *>(rows.data()), rows.size());
+    }
+}
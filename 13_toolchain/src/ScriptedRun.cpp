@@ -0,0 +1,59 @@
+#include "ScriptedRun.h"
+#include "Screen.h"
+#include "definitions.h"
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+
+auto parseAssignment(std::string const &arg) -> std::pair<int, int>
+{
+    auto eq = arg.find('=');
+    if (eq == std::string::npos)
+        throw std::invalid_argument("Expected addr=value, got " + arg);
+    return {std::stoi(arg.substr(0, eq)), std::stoi(arg.substr(eq + 1))};
+}
+
+auto ScriptedRun::run(uint64_t maxSteps, std::vector<int16_t> &ram,
+                      std::function<uint64_t(uint64_t)> const &step,
+                      std::function<uint64_t()> const &clock) -> uint64_t
+{
+    auto capture = [&]() {
+        auto screen = ram.data() + SCREEN_BASE;
+        if (!mScreenshotPath.empty())
+            writeScreen(mFrameSteps > 0 ? framePath(mScreenshotPath, mFrame) : mScreenshotPath,
+                        screen);
+        if (mScreenHashes)
+            std::cout << clock() << " " << std::hex << std::setw(16) << std::setfill('0')
+                      << screenHash(screen) << std::dec << std::setfill(' ') << std::endl;
+        mFrame++;
+    };
+
+    uint64_t steps = 0;
+    uint64_t nextFrame = mFrameSteps;
+    bool captured = false;
+    while (true)
+    {
+        auto budget = maxSteps - steps;
+        if (mFrameSteps > 0)
+            budget = std::min(budget, nextFrame - steps);
+        if (!mInput.empty())
+        {
+            ram[KBD_ADDRESS] = mInput.keyAt(clock());
+            budget = std::min(budget, mInput.nextEvent(clock()) - clock());
+        }
+        auto executed = step(budget);
+        steps += executed;
+        captured = mFrameSteps > 0 && steps == nextFrame;
+        if (captured)
+        {
+            capture();
+            nextFrame += mFrameSteps;
+        }
+        if (executed < budget || steps == maxSteps)
+            break;
+    }
+    if (!captured && (mFrameSteps > 0 || !mScreenshotPath.empty() || mScreenHashes))
+        capture();
+    return steps;
+}
@@ -0,0 +1,39 @@
+#include "Snapshot.h"
+#include "MappedFile.h"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+auto writeSnapshot(std::string const &path, SnapshotHeader header,
+                   std::vector<int16_t> const &ram) -> void
+{
+    std::memcpy(header.magic, "HSS1", 4);
+    header.ramSize = static_cast<uint32_t>(ram.size());
+    header.reserved = 0;
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("Could not open " + path);
+    file.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    file.write(reinterpret_cast<char const *>(ram.data()), ram.size() * sizeof(int16_t));
+    if (!file)
+        throw std::runtime_error("Could not write " + path);
+}
+
+auto readSnapshot(std::string const &path, uint64_t program, std::vector<int16_t> &ram)
+    -> SnapshotHeader
+{
+    auto file = MappedFile(path);
+    SnapshotHeader header{};
+    if (file.size() >= sizeof(header))
+        std::memcpy(&header, file.data(), sizeof(header));
+    if (file.size() < sizeof(header) || std::memcmp(header.magic, "HSS1", 4) != 0)
+        throw std::runtime_error(path + ": not a snapshot");
+    if (header.ramSize != ram.size() ||
+        file.size() != sizeof(header) + header.ramSize * sizeof(int16_t))
+        throw std::runtime_error(path + ": snapshot does not match the RAM size");
+    if (header.program != program)
+        throw std::runtime_error(path + ": snapshot was taken from a different program");
+    std::memcpy(ram.data(), file.data() + sizeof(header), ram.size() * sizeof(int16_t));
+    return header;
+}
@@ -0,0 +1,126 @@
+#include "SourceMap.h"
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+inline auto write_varint(std::string &out, uint64_t value) -> void
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+inline auto zigzag(int64_t value) -> uint64_t
+{
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline auto unzigzag(uint64_t value) -> int64_t
+{
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+auto SourceMap::addFile(std::string const &file) -> int
+{
+    for (size_t i = 0; i < mFiles.size(); i++)
+        if (mFiles[i] == file)
+            return static_cast<int>(i);
+    mFiles.push_back(file);
+    return static_cast<int>(mFiles.size()) - 1;
+}
+
+auto SourceMap::add(std::string const &file, int line) -> void
+{
+    mLocations.push_back(SourceLocation{this->addFile(file), line});
+}
+
+auto SourceMap::write(std::string const &path) -> void
+{
+    std::string out = "HSM1";
+    write_varint(out, mFiles.size());
+    for (auto &file : mFiles)
+    {
+        write_varint(out, file.size());
+        out += file;
+    }
+
+    std::vector<std::pair<uint64_t, SourceLocation>> runs;
+    for (auto &location : mLocations)
+    {
+        if (!runs.empty() && runs.back().second.file == location.file &&
+            runs.back().second.line == location.line)
+            runs.back().first++;
+        else
+            runs.push_back({1, location});
+    }
+    write_varint(out, runs.size());
+    SourceLocation previous{0, 0};
+    for (auto &[length, location] : runs)
+    {
+        write_varint(out, length);
+        write_varint(out, zigzag(location.file - previous.file));
+        write_varint(out, zigzag(location.line - previous.line));
+        previous = location;
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("Could not open " + path);
+    file << out;
+}
+
+auto SourceMap::read(std::string const &path) -> void
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+        throw std::runtime_error("Could not open " + path);
+    std::string content{std::istreambuf_iterator<char>(file),
+                        std::istreambuf_iterator<char>()};
+    if (content.compare(0, 4, "HSM1") != 0)
+        throw std::runtime_error(path + ": not a source map");
+
+    size_t pos = 4;
+    auto varint = [&]() -> uint64_t {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            if (pos >= content.size())
+                throw std::runtime_error(path + ": truncated source map");
+            auto byte = static_cast<uint8_t>(content[pos++]);
+            value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                return value;
+        }
+        throw std::runtime_error(path + ": malformed varint");
+    };
+
+    mFiles.clear();
+    mLocations.clear();
+    auto nFiles = varint();
+    for (uint64_t i = 0; i < nFiles; i++)
+    {
+        auto length = varint();
+        if (pos + length > content.size())
+            throw std::runtime_error(path + ": truncated source map");
+        mFiles.push_back(content.substr(pos, length));
+        pos += length;
+    }
+
+    auto nRuns = varint();
+    SourceLocation location{0, 0};
+    for (uint64_t i = 0; i < nRuns; i++)
+    {
+        auto length = varint();
+        location.file += static_cast<int>(unzigzag(varint()));
+        location.line += static_cast<int>(unzigzag(varint()));
+        if (location.line != 0 &&
+            (location.file < 0 || static_cast<size_t>(location.file) >= mFiles.size()))
+            throw std::runtime_error(path + ": file index out of range");
+        if (mLocations.size() + length > 65536)
+            throw std::runtime_error(path + ": more locations than addresses");
+        mLocations.insert(mLocations.end(), length, location);
+    }
+}
@@ -0,0 +1,119 @@
+#include "TestScript.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+// All .tst files of a directory tree, or the file itself.
+inline auto find_scripts(std::string const &pathOrDir) -> std::vector<std::string>
+{
+    std::vector<std::string> scripts;
+    if (!std::filesystem::is_directory(pathOrDir))
+        return {pathOrDir};
+    for (auto &entry : std::filesystem::recursive_directory_iterator(pathOrDir))
+        if (entry.is_regular_file() && entry.path().extension() == ".tst")
+            scripts.push_back(entry.path().string());
+    std::sort(scripts.begin(), scripts.end());
+    return scripts;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        throw std::invalid_argument(
+            "Usage: 'TestRunner <file.tst|dir>... [-j threads] [--lib dir] [--translate] "
+            "[--out dir]'");
+    }
+
+    std::vector<std::string> scripts;
+    std::vector<std::string> libraries;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    bool translate = false;
+    std::string outputDir = "";
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-j" && i + 1 < argc)
+            threads = std::max(1, std::stoi(argv[++i]));
+        else if (arg == "--lib" && i + 1 < argc)
+            libraries.push_back(argv[++i]);
+        else if (arg == "--translate")
+            translate = true;
+        else if (arg == "--out" && i + 1 < argc)
+            outputDir = argv[++i];
+        else if (arg.rfind("-", 0) == 0)
+            throw std::invalid_argument("Unknown option: " + arg);
+        else
+        {
+            auto found = find_scripts(arg);
+            scripts.insert(scripts.end(), found.begin(), found.end());
+        }
+    }
+
+    // Concurrent runs write to a directory of their own, removed if all passed.
+    bool ownOutputDir = outputDir.empty();
+    if (ownOutputDir)
+        outputDir = (std::filesystem::temp_directory_path() /
+                     ("TestRunner-" + std::to_string(getpid())))
+                        .string();
+
+    // Workers take the next script until all are done, results are printed in
+    // the order the scripts finish.
+    std::atomic<size_t> next = 0;
+    std::atomic<int> failures = 0;
+    std::mutex printMutex;
+    auto worker = [&]() {
+        for (size_t i = next++; i < scripts.size(); i = next++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            TestResult result;
+            try
+            {
+                auto script = TestScript(scripts[i]);
+                for (auto &library : libraries)
+                    script.addLibrary(library);
+                script.setTranslate(translate);
+                script.setOutputDirectory(outputDir);
+                result = script.run();
+            }
+            catch (std::exception const &e)
+            {
+                result = TestResult{false, e.what(), 0};
+            }
+            std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+            std::lock_guard<std::mutex> lock(printMutex);
+            if (!result.passed)
+                failures++;
+            std::cout << (result.passed ? "PASS " : "FAIL ") << scripts[i] << " ("
+                      << result.steps << " steps, " << static_cast<int>(seconds.count() * 1000)
+                      << " ms)" << std::endl;
+            if (!result.passed)
+                std::cout << "     " << result.message << std::endl;
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (unsigned i = 0; i < std::min<size_t>(threads, scripts.size()); i++)
+        pool.emplace_back(worker);
+    for (auto &thread : pool)
+        thread.join();
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+    std::cout << scripts.size() - failures << " of " << scripts.size() << " scripts passed in "
+              << static_cast<int>(seconds.count() * 1000) << " ms" << std::endl;
+    if (ownOutputDir && failures == 0)
+        std::filesystem::remove_all(outputDir);
+    else if (std::filesystem::exists(outputDir))
+        std::cout << "Outputs in " << outputDir << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,457 @@
+#include "TestScript.h"
+#include "CmpFormat.h"
+#include "CodeWriter.h"
+#include "HackAssembler.h"
+#include "VMProgram.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+
+// Serializes translations and output files, scripts of the same directory may
+// run concurrently and share them.
+inline std::mutex fileMutex;
+
+inline const std::map<std::string, int> pointerAddresses{
+    {"sp", 0}, {"local", 1}, {"argument", 2}, {"this", 3}, {"that", 4},
+};
+
+inline const std::map<std::string, TestCommandType> stringToTestCommand{
+    {"load", TestCommandType::LOAD},
+    {"output-file", TestCommandType::OUTPUT_FILE},
+    {"compare-to", TestCommandType::COMPARE_TO},
+    {"output-list", TestCommandType::OUTPUT_LIST},
+    {"set", TestCommandType::SET},
+    {"repeat", TestCommandType::REPEAT},
+    {"ticktock", TestCommandType::TICKTOCK},
+    {"vmstep", TestCommandType::VMSTEP},
+    {"output", TestCommandType::OUTPUT},
+    {"echo", TestCommandType::ECHO},
+};
+
+TestScript::TestScript(std::string path)
+    : mPath(path), mDirectory(std::filesystem::path(path).parent_path().string()),
+      mOutputDirectory(), mCommands(), mLibraries(), mTranslate(false), mCpu(nullptr),
+      mVm(nullptr), mOutputFile(""), mCompareFile(""), mColumns(), mOutput(), mSteps(0)
+{
+    if (mDirectory.empty())
+        mDirectory = ".";
+    this->setOutputDirectory((std::filesystem::temp_directory_path() / "TestRunner").string());
+    this->parse();
+}
+
+auto TestScript::setOutputDirectory(std::string const &dir) -> void
+{
+    // Scripts and directories of different tests may share names, their paths
+    // do not.
+    auto directory = std::filesystem::absolute(mDirectory).lexically_normal().relative_path();
+    auto script = std::filesystem::path(mPath).stem();
+    mOutputDirectory = (std::filesystem::path(dir) / directory / script).string();
+}
+
+auto TestScript::parse() -> void
+{
+    std::ifstream file(mPath);
+    if (!file.is_open())
+        throw std::runtime_error("Could not open " + mPath);
+    std::string content{std::istreambuf_iterator<char>(file),
+                        std::istreambuf_iterator<char>()};
+
+    // Tokens are words, quoted strings and the separators , ; { }
+    std::vector<std::pair<std::string, int>> tokens;
+    int line = 1;
+    for (size_t i = 0; i < content.size();)
+    {
+        char c = content[i];
+        if (c == '\n')
+            line++;
+        if (std::isspace(static_cast<unsigned char>(c)))
+            i++;
+        else if (content.compare(i, 2, "//") == 0)
+            i = content.find('\n', i);
+        else if (content.compare(i, 2, "/*") == 0)
+        {
+            auto end = content.find("*/", i + 2);
+            if (end == std::string::npos)
+                throw std::runtime_error(mPath + ":" + std::to_string(line) +
+                                         ": unterminated comment");
+            line += static_cast<int>(
+                std::count(content.begin() + i, content.begin() + end, '\n'));
+            i = end + 2;
+        }
+        else if (c == '"')
+        {
+            auto end = content.find('"', i + 1);
+            if (end == std::string::npos)
+                throw std::runtime_error(mPath + ":" + std::to_string(line) +
+                                         ": unterminated string");
+            tokens.push_back({content.substr(i, end + 1 - i), line});
+            i = end + 1;
+        }
+        else if (c == ',' || c == ';' || c == '{' || c == '}')
+        {
+            tokens.push_back({std::string(1, c), line});
+            i++;
+        }
+        else
+        {
+            auto end = content.find_first_of(" \t\r\n,;{}\"", i);
+            if (end == std::string::npos)
+                end = content.size();
+            tokens.push_back({content.substr(i, end - i), line});
+            i = end;
+        }
+        if (i == std::string::npos)
+            break;
+    }
+
+    size_t pos = 0;
+    auto error = [&](std::string const &message) {
+        int at = pos < tokens.size() ? tokens[pos].second : line;
+        return std::runtime_error(mPath + ":" + std::to_string(at) + ": " + message);
+    };
+    auto isSeparator = [&](size_t i) {
+        return i >= tokens.size() || tokens[i].first == "," || tokens[i].first == ";" ||
+               tokens[i].first == "{" || tokens[i].first == "}";
+    };
+
+    std::function<std::vector<TestCommand>(bool)> parseCommands = [&](bool inBlock) {
+        std::vector<TestCommand> commands;
+        while (pos < tokens.size())
+        {
+            if (tokens[pos].first == "}")
+            {
+                if (!inBlock)
+                    throw error("unexpected }");
+                pos++;
+                return commands;
+            }
+            auto found = stringToTestCommand.find(tokens[pos].first);
+            if (found == stringToTestCommand.end())
+                throw error("unsupported command " + tokens[pos].first);
+            auto command = TestCommand{found->second, "", 0, 0, {}, {}, tokens[pos].second};
+            pos++;
+
+            std::vector<std::string> arguments;
+            while (!isSeparator(pos))
+                arguments.push_back(tokens[pos++].first);
+            auto expectArguments = [&](size_t min, size_t max) {
+                if (arguments.size() < min || arguments.size() > max)
+                    throw error("wrong number of arguments for " + found->first);
+            };
+
+            switch (command.type)
+            {
+            case TestCommandType::LOAD:
+                expectArguments(0, 1);
+                command.argument = arguments.empty() ? "" : arguments[0];
+                break;
+            case TestCommandType::OUTPUT_FILE:
+            case TestCommandType::COMPARE_TO:
+                expectArguments(1, 1);
+                command.argument = arguments[0];
+                break;
+            case TestCommandType::ECHO:
+                expectArguments(1, 1);
+                command.argument = arguments[0].substr(1, arguments[0].size() - 2);
+                break;
+            case TestCommandType::SET:
+                expectArguments(2, 2);
+                command.argument = arguments[0];
+                command.value = std::stoi(arguments[1]);
+                if (command.value < -32768 || command.value > 65535)
+                    throw error("value out of range: " + arguments[1]);
+                break;
+            case TestCommandType::OUTPUT_LIST:
+                for (auto &argument : arguments)
+                {
+                    // name%Dleft.width.right
+                    auto percent = argument.find('%');
+                    int left, width, right;
+                    char format = 0;
+                    if (percent == std::string::npos ||
+                        std::sscanf(argument.c_str() + percent, "%%%c%d.%d.%d", &format, &left,
+                                    &width, &right) != 4)
+                        throw error("malformed output column " + argument);
+                    if (format != 'D')
+                        throw error("unsupported output format %" + std::string(1, format));
+                    command.columns.push_back(
+                        OutputColumn{argument.substr(0, percent), left, width, right});
+                }
+                break;
+            case TestCommandType::REPEAT:
+                expectArguments(1, 1);
+                command.count = std::stoull(arguments[0]);
+                if (pos >= tokens.size() || tokens[pos].first != "{")
+                    throw error("expected { after repeat");
+                pos++;
+                command.body = parseCommands(true);
+                commands.push_back(std::move(command));
+                continue;
+            default:
+                expectArguments(0, 0);
+                break;
+            }
+
+            if (pos >= tokens.size() || (tokens[pos].first != "," && tokens[pos].first != ";"))
+                throw error("expected , or ; after " + found->first);
+            pos++;
+            commands.push_back(std::move(command));
+        }
+        if (inBlock)
+            throw error("missing }");
+        return commands;
+    };
+    mCommands = parseCommands(false);
+}
+
+auto TestScript::run() -> TestResult
+{
+    mSteps = 0;
+    mOutputFile = "";
+    mCompareFile = "";
+    mColumns.clear();
+    mOutput.clear();
+    try
+    {
+        this->execute(mCommands);
+        if (!mOutputFile.empty())
+        {
+            std::lock_guard<std::mutex> lock(fileMutex);
+            std::filesystem::create_directories(mOutputDirectory);
+            std::ofstream out(std::filesystem::path(mOutputDirectory) / mOutputFile);
+            for (auto &line : mOutput)
+                out << line << std::endl;
+        }
+        auto mismatch = mCompareFile.empty() ? "" : this->compare();
+        return TestResult{mismatch.empty(), mismatch, mSteps};
+    }
+    catch (std::exception const &e)
+    {
+        return TestResult{false, e.what(), mSteps};
+    }
+}
+
+auto TestScript::execute(std::vector<TestCommand> const &commands) -> void
+{
+    for (auto &command : commands)
+    {
+        switch (command.type)
+        {
+        case TestCommandType::LOAD:
+            this->load(command);
+            break;
+        case TestCommandType::OUTPUT_FILE:
+            mOutputFile = command.argument;
+            break;
+        case TestCommandType::COMPARE_TO:
+            mCompareFile = command.argument;
+            break;
+        case TestCommandType::OUTPUT_LIST:
+        {
+            mColumns = command.columns;
+            std::string header = "|";
+            for (auto &column : mColumns)
+            {
+                auto width = column.left + column.width + column.right;
+                header += formatHeader(column.name, width) + "|";
+            }
+            mOutput.push_back(header);
+            break;
+        }
+        case TestCommandType::SET:
+            this->poke(this->address(command.argument, command.line),
+                       static_cast<int16_t>(command.value));
+            break;
+        case TestCommandType::REPEAT:
+            // The usual repeat n { ticktock; } runs in one go.
+            if (command.body.size() == 1 && (command.body[0].type == TestCommandType::TICKTOCK ||
+                                             command.body[0].type == TestCommandType::VMSTEP))
+                this->step(command.body[0].type, command.count, command.body[0].line);
+            else
+            {
+                for (uint64_t i = 0; i < command.count; i++)
+                    this->execute(command.body);
+            }
+            break;
+        case TestCommandType::TICKTOCK:
+        case TestCommandType::VMSTEP:
+            this->step(command.type, 1, command.line);
+            break;
+        case TestCommandType::OUTPUT:
+        {
+            std::string row = "|";
+            for (auto &column : mColumns)
+                row += formatDecimal(this->peek(this->address(column.name, command.line)),
+                                     column.left, column.width, column.right) +
+                       "|";
+            mOutput.push_back(row);
+            break;
+        }
+        case TestCommandType::ECHO:
+            break;
+        }
+    }
+}
+
+auto TestScript::load(TestCommand const &command) -> void
+{
+    auto name = command.argument;
+    auto path = name.empty() ? mDirectory : (std::filesystem::path(mDirectory) / name).string();
+    auto extension = std::filesystem::path(name).extension().string();
+    if (extension == ".asm" || extension == ".hack")
+    {
+        mVm.reset();
+        mCpu = std::make_unique<CPUEmulator>();
+        if (extension == ".hack")
+            mCpu->load(path);
+        else
+        {
+            if (mTranslate || !std::filesystem::exists(path))
+            {
+                path = (std::filesystem::path(mOutputDirectory) / name).string();
+                this->translate(path);
+            }
+            mCpu->setRom(HackAssembler().load(path));
+        }
+    }
+    else if (name.empty() || extension == ".vm" || extension == ".vmb")
+    {
+        mCpu.reset();
+        auto program = VMProgram();
+        program.load(path);
+        for (auto &library : mLibraries)
+            program.loadLibrary(library);
+        mVm = std::make_unique<VMInterpreter>();
+        mVm->load(program);
+    }
+    else
+        throw std::runtime_error(mPath + ":" + std::to_string(command.line) +
+                                 ": cannot load " + name);
+}
+
+auto TestScript::translate(std::string const &asmPath) -> void
+{
+    std::lock_guard<std::mutex> lock(fileMutex);
+    auto program = VMProgram();
+    program.load(mDirectory);
+    std::filesystem::create_directories(std::filesystem::path(asmPath).parent_path());
+
+    auto writer = CodeWriter(asmPath);
+    if (program.hasFunction("Sys.init"))
+        writer.writeInit();
+    for (auto &file : program.files())
+    {
+        writer.setFileName(file.name);
+        writer.translate(file.commands);
+    }
+    writer.writeSharedRoutines();
+    writer.close();
+}
+
+auto TestScript::address(std::string const &name, int line) -> int
+{
+    auto error = [&]() {
+        return std::runtime_error(mPath + ":" + std::to_string(line) + ": unknown variable " +
+                                  name);
+    };
+
+    auto pointer = pointerAddresses.find(name);
+    if (pointer != pointerAddresses.end())
+        return pointer->second;
+
+    auto bracket = name.find('[');
+    if (bracket == std::string::npos || name.back() != ']' || bracket + 2 >= name.size())
+        throw error();
+    auto base = name.substr(0, bracket);
+    auto indexText = name.substr(bracket + 1, name.size() - bracket - 2);
+    if (indexText.find_first_not_of("0123456789") != std::string::npos)
+        throw error();
+    int index = std::stoi(indexText);
+
+    if (base == "RAM")
+        return index;
+    if (base == "temp")
+        return 5 + index;
+    pointer = pointerAddresses.find(base);
+    if (pointer == pointerAddresses.end() || base == "sp")
+        throw error();
+    return this->peek(pointer->second) + index;
+}
+
+auto TestScript::peek(int address) -> int16_t
+{
+    if (mCpu)
+        return mCpu->peek(address);
+    if (mVm)
+        return mVm->peek(address);
+    throw std::runtime_error(mPath + ": no program loaded");
+}
+
+auto TestScript::poke(int address, int16_t value) -> void
+{
+    if (mCpu)
+        mCpu->poke(address, value);
+    else if (mVm)
+        mVm->poke(address, value);
+    else
+        throw std::runtime_error(mPath + ": no program loaded");
+}
+
+auto TestScript::step(TestCommandType type, uint64_t count, int line) -> void
+{
+    if (type == TestCommandType::TICKTOCK)
+    {
+        if (!mCpu)
+            throw std::runtime_error(mPath + ":" + std::to_string(line) +
+                                     ": ticktock needs a loaded .asm or .hack program");
+        mSteps += mCpu->run(count);
+    }
+    else
+    {
+        if (!mVm)
+            throw std::runtime_error(mPath + ":" + std::to_string(line) +
+                                     ": vmstep needs loaded .vm files");
+        mSteps += mVm->run(count);
+    }
+}
+
+auto TestScript::compare() -> std::string
+{
+    auto path = (std::filesystem::path(mDirectory) / mCompareFile).string();
+    std::ifstream file(path);
+    if (!file.is_open())
+        throw std::runtime_error("Could not open " + path);
+    std::vector<std::string> expected;
+    std::string text;
+    while (std::getline(file, text))
+    {
+        text.erase(text.find_last_not_of(" \t\r") + 1);
+        expected.push_back(text);
+    }
+    while (!expected.empty() && expected.back().empty())
+        expected.pop_back();
+
+    for (size_t i = 0; i < mOutput.size() || i < expected.size(); i++)
+    {
+        auto where = "comparison failure at line " + std::to_string(i + 1);
+        if (i >= expected.size())
+            return where + ": " + mCompareFile + " ends before the output";
+        if (i >= mOutput.size())
+            return where + ": output ends before " + mCompareFile;
+        auto actual = mOutput[i];
+        actual.erase(actual.find_last_not_of(" \t") + 1);
+        bool same = actual.size() == expected[i].size();
+        for (size_t c = 0; same && c < actual.size(); c++)
+            same = expected[i][c] == '*' || expected[i][c] == actual[c];
+        if (!same)
+            return where + ": expected " + expected[i] + ", got " + actual;
+    }
+    return "";
+}
@@ -0,0 +1,216 @@
+#include "VMBytecode.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+// Codes of the file format, independent of the enums.
+inline const std::vector<CommandType> typeCodes{
+    CommandType::PUSH,  CommandType::POP,      CommandType::ARITHMETIC,
+    CommandType::LABEL, CommandType::GOTO,     CommandType::IF,
+    CommandType::FUNCTION, CommandType::CALL,  CommandType::RETURN,
+};
+
+inline const std::vector<Segment> segmentCodes{
+    Segment::CONST, Segment::ARG,  Segment::LOCAL,   Segment::STATIC,
+    Segment::THIS,  Segment::THAT, Segment::POINTER, Segment::TEMP,
+};
+
+inline const std::vector<Command> commandCodes{
+    Command::ADD, Command::SUB, Command::NEG, Command::EQ,  Command::GT,
+    Command::LT,  Command::AND, Command::OR,  Command::NOT,
+};
+
+inline constexpr size_t HEADER_SIZE = 16;
+inline constexpr size_t FUNCTION_SIZE = 12;
+inline constexpr size_t COMMAND_SIZE = 8;
+
+template <typename T>
+inline auto code_of(std::vector<T> const &codes, T value) -> uint8_t
+{
+    return static_cast<uint8_t>(std::find(codes.begin(), codes.end(), value) - codes.begin());
+}
+
+inline auto get_u32(char const *data) -> uint32_t
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++)
+        value |= static_cast<uint32_t>(static_cast<uint8_t>(data[i])) << (8 * i);
+    return value;
+}
+
+inline auto put_u32(std::string &out, uint32_t value) -> void
+{
+    for (int shift = 0; shift < 32; shift += 8)
+        out.push_back(static_cast<char>(value >> shift));
+}
+
+auto readBytecode(std::string const &path) -> VMFile
+{
+    auto mapped = MappedFile(path);
+    auto data = mapped.data();
+    auto size = mapped.size();
+    auto error = [&](std::string const &message) {
+        return std::runtime_error(path + ": " + message);
+    };
+    if (size < HEADER_SIZE || std::memcmp(data, "VMB1", 4) != 0)
+        throw error("not a VM bytecode file");
+
+    uint64_t nCommands = get_u32(data + 4);
+    uint64_t nFunctions = get_u32(data + 8);
+    uint64_t nStringBytes = get_u32(data + 12);
+    auto commandsStart = HEADER_SIZE + nFunctions * FUNCTION_SIZE;
+    auto stringsStart = commandsStart + nCommands * COMMAND_SIZE;
+    if (stringsStart + nStringBytes != size ||
+        (nStringBytes > 0 && data[size - 1] != '\0'))
+        throw error("truncated VM bytecode file");
+    auto string = [&](uint32_t offset) -> std::string {
+        if (offset >= nStringBytes)
+            throw error("name out of range");
+        return std::string(data + stringsStart + offset);
+    };
+
+    VMFile file;
+    file.path = path;
+    file.name = std::filesystem::path(path).stem().string();
+    file.commands.reserve(nCommands);
+    for (uint64_t i = 0; i < nCommands; i++)
+    {
+        auto entry = data + commandsStart + i * COMMAND_SIZE;
+        auto type = static_cast<uint8_t>(entry[0]);
+        auto kind = static_cast<uint8_t>(entry[1]);
+        auto count = static_cast<int>(static_cast<uint8_t>(entry[2]) |
+                                      static_cast<uint8_t>(entry[3]) << 8);
+        auto arg = get_u32(entry + 4);
+        if (type >= typeCodes.size())
+            throw error("invalid command type " + std::to_string(type));
+
+        VMCommand command{.type = typeCodes[type],
+                          .command = Command::NONE,
+                          .segment = Segment::NONE,
+                          .name = "",
+                          .index = 0,
+                          .line = static_cast<int>(i) + 1,
+                          .sourceLine = 0};
+        switch (command.type)
+        {
+        case CommandType::ARITHMETIC:
+            if (kind >= commandCodes.size())
+                throw error("invalid arithmetic command " + std::to_string(kind));
+            command.command = commandCodes[kind];
+            break;
+        case CommandType::PUSH:
+        case CommandType::POP:
+            if (kind >= segmentCodes.size() || arg > 32767)
+                throw error("invalid segment access");
+            command.segment = segmentCodes[kind];
+            command.index = static_cast<int>(arg);
+            break;
+        case CommandType::FUNCTION:
+        case CommandType::CALL:
+            command.index = count;
+            command.name = string(arg);
+            break;
+        case CommandType::LABEL:
+        case CommandType::GOTO:
+        case CommandType::IF:
+            command.name = string(arg);
+            break;
+        case CommandType::RETURN:
+            break;
+        }
+        file.commands.push_back(std::move(command));
+    }
+
+    // The index must agree with the function commands.
+    for (uint64_t i = 0; i < nFunctions; i++)
+    {
+        auto entry = data + HEADER_SIZE + i * FUNCTION_SIZE;
+        auto index = get_u32(entry + 4);
+        if (index >= nCommands || file.commands[index].type != CommandType::FUNCTION ||
+            file.commands[index].name != string(get_u32(entry)))
+            throw error("function index does not match the code");
+    }
+    return file;
+}
+
+auto writeBytecode(VMFile const &file, std::string const &path) -> void
+{
+    std::string strings;
+    std::map<std::string, uint32_t> offsets;
+    auto name = [&](std::string const &value) -> uint32_t {
+        auto found = offsets.find(value);
+        if (found != offsets.end())
+            return found->second;
+        auto offset = static_cast<uint32_t>(strings.size());
+        strings += value;
+        strings.push_back('\0');
+        offsets[value] = offset;
+        return offset;
+    };
+
+    std::string functions;
+    std::string commands;
+    uint32_t nFunctions = 0;
+    for (size_t i = 0; i < file.commands.size(); i++)
+    {
+        auto &command = file.commands[i];
+        uint8_t kind = 0;
+        uint32_t count = 0;
+        uint32_t arg = 0;
+        switch (command.type)
+        {
+        case CommandType::ARITHMETIC:
+            kind = code_of(commandCodes, command.command);
+            break;
+        case CommandType::PUSH:
+        case CommandType::POP:
+            kind = code_of(segmentCodes, command.segment);
+            arg = static_cast<uint32_t>(command.index);
+            break;
+        case CommandType::FUNCTION:
+        case CommandType::CALL:
+            count = static_cast<uint32_t>(command.index);
+            arg = name(command.name);
+            break;
+        case CommandType::LABEL:
+        case CommandType::GOTO:
+        case CommandType::IF:
+            arg = name(command.name);
+            break;
+        case CommandType::RETURN:
+            break;
+        }
+        if (count > 0xffff)
+            throw std::runtime_error(path + ": too many arguments or locals in " +
+                                     command.name);
+        commands.push_back(static_cast<char>(code_of(typeCodes, command.type)));
+        commands.push_back(static_cast<char>(kind));
+        commands.push_back(static_cast<char>(count & 0xff));
+        commands.push_back(static_cast<char>(count >> 8));
+        put_u32(commands, arg);
+
+        if (command.type == CommandType::FUNCTION)
+        {
+            put_u32(functions, name(command.name));
+            put_u32(functions, static_cast<uint32_t>(i));
+            put_u32(functions, count);
+            nFunctions++;
+        }
+    }
+
+    std::string out = "VMB1";
+    put_u32(out, static_cast<uint32_t>(file.commands.size()));
+    put_u32(out, nFunctions);
+    put_u32(out, static_cast<uint32_t>(strings.size()));
+    out += functions + commands + strings;
+
+    std::ofstream stream(path, std::ios::binary);
+    if (!stream.is_open())
+        throw std::runtime_error("Could not open " + path);
+    stream << out;
+}
@@ -0,0 +1,163 @@
+#include "BlockCounts.h"
+#include "InputScript.h"
+#include "Profiler.h"
+#include "ScriptedRun.h"
+#include "VMInterpreter.h"
+#include "VMProgram.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Programs halt by returning from Sys.init or, with --native-os, at a call the
+// OS leaves to its VM code when there is none.
+inline auto halt_reason(VMInterpreter &vm) -> std::string
+{
+    if (vm.pc() < static_cast<int>(vm.code().size()))
+        return ", stopped in " + vm.currentFunction() + " at a call without VM code";
+    return ", returned from Sys.init";
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        throw std::invalid_argument(
+            "Usage: 'VMEmulator <file.vm|file.vmb|dir> [--lib dir] [-s steps] "
+            "[--set addr=value]... [--no-fuse] [--native-os] [--restore file] "
+            "[--snapshot file] [--screenshot file] [--frames steps] [--screen-hash] "
+            "[--input file] [--profile file] [--folded file] [--block-counts file] "
+            "[--dump addr...]'");
+    }
+
+    std::string pathOrDir = std::string(argv[1]);
+    std::vector<std::string> libraries;
+    uint64_t maxSteps = 10000000;
+    std::vector<std::pair<int, int>> assignments;
+    std::vector<int> dumpAddresses;
+    bool fusion = true;
+    bool nativeOS = false;
+    std::string profilePath = "";
+    std::string foldedPath = "";
+    std::string countsPath = "";
+    std::string restorePath = "";
+    std::string snapshotPath = "";
+    std::string screenshotPath = "";
+    uint64_t frameSteps = 0;
+    bool screenHashes = false;
+    auto input = InputScript();
+    for (int i = 2; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--lib" && i + 1 < argc)
+            libraries.push_back(argv[++i]);
+        else if (arg == "-s" && i + 1 < argc)
+            maxSteps = std::stoull(argv[++i]);
+        else if (arg == "--set" && i + 1 < argc)
+            assignments.push_back(parseAssignment(argv[++i]));
+        else if (arg == "--no-fuse")
+            fusion = false;
+        else if (arg == "--native-os")
+            nativeOS = true;
+        else if (arg == "--restore" && i + 1 < argc)
+            restorePath = argv[++i];
+        else if (arg == "--snapshot" && i + 1 < argc)
+            snapshotPath = argv[++i];
+        else if (arg == "--screenshot" && i + 1 < argc)
+            screenshotPath = argv[++i];
+        else if (arg == "--frames" && i + 1 < argc)
+            frameSteps = std::stoull(argv[++i]);
+        else if (arg == "--screen-hash")
+            screenHashes = true;
+        else if (arg == "--input" && i + 1 < argc)
+            input.load(argv[++i]);
+        else if (arg == "--profile" && i + 1 < argc)
+            profilePath = argv[++i];
+        else if (arg == "--folded" && i + 1 < argc)
+            foldedPath = argv[++i];
+        else if (arg == "--block-counts" && i + 1 < argc)
+            countsPath = argv[++i];
+        else if (arg == "--dump")
+        {
+            // All remaining arguments are addresses.
+            while (i + 1 < argc)
+                dumpAddresses.push_back(std::stoi(argv[++i]));
+        }
+        else
+            throw std::invalid_argument("Unknown option: " + arg);
+    }
+
+    auto program = VMProgram();
+    program.load(pathOrDir);
+    for (auto &library : libraries)
+        program.loadLibrary(library);
+
+    auto vm = VMInterpreter();
+    vm.setFusion(fusion);
+    vm.setNativeOS(nativeOS);
+    vm.load(program);
+    if (!restorePath.empty())
+        vm.restoreSnapshot(restorePath);
+    std::unique_ptr<Profiler> profiler;
+    if (!profilePath.empty() || !foldedPath.empty() || !countsPath.empty())
+    {
+        profiler = std::make_unique<Profiler>(vm.functionNames(), vm.functionOf());
+        profiler->setSources(vm.sources());
+        vm.setProfiler(profiler.get());
+    }
+    for (auto &[address, value] : assignments)
+        vm.poke(address, static_cast<int16_t>(value));
+
+    auto scriptedRun = ScriptedRun();
+    scriptedRun.setInput(input);
+    scriptedRun.setFrames(frameSteps);
+    scriptedRun.setScreenshot(screenshotPath);
+    scriptedRun.setScreenHashes(screenHashes);
+
+    auto start = std::chrono::steady_clock::now();
+    auto steps = scriptedRun.run(
+        maxSteps, vm.ram(), [&](uint64_t budget) { return vm.run(budget); },
+        [&]() { return vm.steps(); });
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+
+    std::cerr << pathOrDir << ": " << steps << " steps in " << vm.dispatches()
+              << " dispatches"
+              << (vm.halted() ? halt_reason(vm) : "") << " ("
+              << static_cast<uint64_t>(steps / seconds.count() / 1e6)
+              << " million steps per second)" << std::endl;
+    if (!dumpAddresses.empty())
+        vm.dumpRam(dumpAddresses, std::cout);
+    if (!snapshotPath.empty())
+        vm.saveSnapshot(snapshotPath);
+
+    if (!profilePath.empty())
+    {
+        std::ofstream out(profilePath);
+        profiler->writeFlat(out);
+        out << std::endl;
+        profiler->writeCallGraph(out);
+    }
+    if (!foldedPath.empty())
+    {
+        std::ofstream out(foldedPath);
+        profiler->writeFolded(out);
+    }
+    if (!countsPath.empty())
+    {
+        auto counts = BlockCounts();
+        auto &origins = vm.origins();
+        for (size_t i = 0; i < origins.size(); i++)
+        {
+            if (profiler->counts()[i] == 0)
+                continue;
+            auto &file = program.files()[origins[i].first];
+            counts.add(file.name, static_cast<int>(file.commands.size()), origins[i].second,
+                       CommandCount{profiler->counts()[i], profiler->taken()[i]});
+        }
+        counts.write(countsPath);
+    }
+    return 0;
+}
@@ -0,0 +1,696 @@
+#include "VMInterpreter.h"
+#include "CmpFormat.h"
+#include "NativeOS.h"
+#include "Snapshot.h"
+#include <stdexcept>
+
+// Return address of the bootstrap frame, returning there ends the program.
+inline constexpr uint16_t RETURN_TO_HALT = 0xffff;
+
+auto VMInterpreter::load(VMProgram &program) -> void
+{
+    static const std::map<Segment, OpCode> pushOps{
+        {Segment::CONST, OpCode::PUSH_CONST}, {Segment::LOCAL, OpCode::PUSH_LOCAL},
+        {Segment::ARG, OpCode::PUSH_ARG},     {Segment::THIS, OpCode::PUSH_THIS},
+        {Segment::THAT, OpCode::PUSH_THAT},
+    };
+    static const std::map<Segment, OpCode> popOps{
+        {Segment::LOCAL, OpCode::POP_LOCAL}, {Segment::ARG, OpCode::POP_ARG},
+        {Segment::THIS, OpCode::POP_THIS},   {Segment::THAT, OpCode::POP_THAT},
+    };
+    static const std::map<Command, OpCode> arithmeticOps{
+        {Command::ADD, OpCode::ADD}, {Command::SUB, OpCode::SUB}, {Command::NEG, OpCode::NEG},
+        {Command::EQ, OpCode::EQ},   {Command::GT, OpCode::GT},   {Command::LT, OpCode::LT},
+        {Command::AND, OpCode::AND}, {Command::OR, OpCode::OR},   {Command::NOT, OpCode::NOT},
+    };
+
+    mCode.clear();
+    mFunctionNames.clear();
+    mFunctionOf.clear();
+    mSources = SourceMap();
+    mOrigins.clear();
+    mFunctions.clear();
+
+    // Jumps and calls are resolved once all labels and functions are known.
+    struct Reference
+    {
+        size_t instruction;
+        std::string name;
+        std::string location;
+    };
+    std::vector<Reference> jumps;
+    std::vector<Reference> calls;
+    std::unordered_map<std::string, int> labels;
+    int nextStatic = 16;
+
+    auto &files = program.files();
+    for (size_t fileIndex = 0; fileIndex < files.size(); fileIndex++)
+    {
+        auto &file = files[fileIndex];
+        std::map<int, int> statics;
+        std::string function = "";
+        for (size_t commandIndex = 0; commandIndex < file.commands.size(); commandIndex++)
+        {
+            auto &command = file.commands[commandIndex];
+            auto location = file.path + ":" + std::to_string(command.line);
+            auto fixedAddress = [&]() -> int {
+                if (command.segment == Segment::STATIC)
+                {
+                    if (!statics.count(command.index))
+                        statics[command.index] = nextStatic++;
+                    return statics[command.index];
+                }
+                int base = command.segment == Segment::TEMP ? 5 : 3;
+                int size = command.segment == Segment::TEMP ? 8 : 2;
+                if (command.index < 0 || command.index >= size)
+                    throw std::runtime_error(location + ": " +
+                                             segmentToString[command.segment] +
+                                             " index out of range");
+                return base + command.index;
+            };
+
+            VMInstruction instruction{OpCode::RETURN, 1, 0, 0, 0};
+            switch (command.type)
+            {
+            case CommandType::LABEL:
+                labels[function + "$" + command.name] = static_cast<int>(mCode.size());
+                continue;
+            case CommandType::PUSH:
+                if (pushOps.count(command.segment))
+                    instruction = {pushOps.at(command.segment), 1, command.index, 0, 0};
+                else
+                    instruction = {OpCode::PUSH_FIXED, 1, fixedAddress(), 0, 0};
+                break;
+            case CommandType::POP:
+                if (command.segment == Segment::CONST)
+                    throw std::runtime_error(location + ": cannot pop to constant");
+                if (popOps.count(command.segment))
+                    instruction = {popOps.at(command.segment), 1, command.index, 0, 0};
+                else
+                    instruction = {OpCode::POP_FIXED, 1, fixedAddress(), 0, 0};
+                break;
+            case CommandType::ARITHMETIC:
+                instruction = {arithmeticOps.at(command.command), 1, 0, 0, 0};
+                break;
+            case CommandType::GOTO:
+            case CommandType::IF:
+                jumps.push_back({mCode.size(), function + "$" + command.name, location});
+                instruction = {command.type == CommandType::GOTO ? OpCode::GOTO
+                                                                 : OpCode::IF_GOTO,
+                               1, 0, 0, 0};
+                break;
+            case CommandType::FUNCTION:
+                function = command.name;
+                mFunctions[function] = static_cast<int>(mCode.size());
+                mFunctionNames.push_back(function);
+                instruction = {OpCode::FUNCTION, 1, command.index, 0, 0};
+                break;
+            case CommandType::CALL:
+                calls.push_back({mCode.size(), command.name, location});
+                instruction = {OpCode::CALL, 1, command.index, 0, 0};
+                break;
+            case CommandType::RETURN:
+                break;
+            }
+            mCode.push_back(instruction);
+            mOrigins.push_back(
+                {static_cast<int>(fileIndex), static_cast<int>(commandIndex)});
+            int functionIndex = static_cast<int>(mFunctionNames.size()) - 1;
+            mFunctionOf.push_back(function.empty() ? -1 : functionIndex);
+            if (command.sourceLine > 0)
+                mSources.add(file.source, command.sourceLine);
+            else
+                mSources.add(SourceLocation{0, 0});
+        }
+    }
+
+    // Return addresses are stored in 16 bit RAM words.
+    if (mCode.size() >= RETURN_TO_HALT)
+        throw std::runtime_error("Program of " + std::to_string(mCode.size()) +
+                                 " commands is too large");
+
+    // Superinstructions must not swallow a command control flow can enter at.
+    std::vector<bool> isTarget(mCode.size() + 1, false);
+    for (auto &[name, index] : labels)
+        isTarget[index] = true;
+
+    for (auto &jump : jumps)
+    {
+        auto label = labels.find(jump.name);
+        if (label == labels.end())
+            throw std::runtime_error(jump.location + ": unknown label " + jump.name);
+        mCode[jump.instruction].target = label->second;
+    }
+    for (auto &call : calls)
+    {
+        auto &instruction = mCode[call.instruction];
+        auto function = mFunctions.find(call.name);
+        int native = mNativeOS ? findNative(call.name, instruction.arg) : -1;
+        if (function == mFunctions.end() && native < 0)
+            throw std::runtime_error(call.location + ": unknown function " + call.name);
+        instruction.target = function == mFunctions.end() ? -1 : function->second;
+        if (native >= 0)
+        {
+            instruction.op = OpCode::NATIVE;
+            instruction.arg2 = native;
+        }
+        // Returns land behind the call.
+        isTarget[call.instruction + 1] = true;
+    }
+    for (auto &[name, index] : mFunctions)
+        isTarget[index] = true;
+
+    mFused = mCode;
+    if (mFusion)
+        this->fuse(isTarget);
+    this->reset();
+}
+
+auto VMInterpreter::fuse(std::vector<bool> const &isTarget) -> void
+{
+    // Segment pointers as fixed addresses.
+    constexpr int THAT_POINTER = 4;
+    constexpr int TEMP_BASE = 5;
+
+    size_t i = 0;
+    // Command k continues the sequence starting at i.
+    auto continues = [&](size_t k, OpCode op) -> bool {
+        return k < mCode.size() && mCode[k].op == op && (k == i || !isTarget[k]);
+    };
+    auto matches = [&](std::initializer_list<OpCode> ops) -> bool {
+        size_t k = i;
+        for (auto op : ops)
+            if (!continues(k++, op))
+                return false;
+        return true;
+    };
+    // Length of eq|gt|lt [; not] at k and its condition, 0 if there is none.
+    auto comparison = [&](size_t k, uint8_t &condition) -> size_t {
+        if (continues(k, OpCode::LT))
+            condition = 4;
+        else if (continues(k, OpCode::EQ))
+            condition = 2;
+        else if (continues(k, OpCode::GT))
+            condition = 1;
+        else
+            return 0;
+        if (!continues(k + 1, OpCode::NOT))
+            return 1;
+        condition ^= 7;
+        return 2;
+    };
+
+    while (i < mCode.size())
+    {
+        auto const &first = mCode[i];
+        VMInstruction fused{first.op, 1, first.arg, first.arg2, first.target, 0};
+        uint8_t condition = 0;
+        size_t length = 0;
+
+        // Longest patterns first.
+        if (matches({OpCode::PUSH_LOCAL, OpCode::PUSH_CONST}) &&
+            (length = comparison(i + 2, condition)) &&
+            continues(i + 2 + length, OpCode::IF_GOTO))
+            fused = {OpCode::CMP_LOCAL_IF, static_cast<uint8_t>(length + 3), first.arg,
+                     mCode[i + 1].arg, mCode[i + 2 + length].target, condition};
+        else if (matches({OpCode::PUSH_CONST, OpCode::PUSH_LOCAL, OpCode::ADD,
+                          OpCode::POP_FIXED, OpCode::PUSH_THAT}) &&
+                 mCode[i + 3].arg == THAT_POINTER && mCode[i + 4].arg == 0)
+            fused = {OpCode::PUSH_ELEMENT, 5, mCode[i + 1].arg, first.arg, 0};
+        else if ((matches({OpCode::PUSH_LOCAL, OpCode::PUSH_CONST, OpCode::ADD,
+                           OpCode::POP_LOCAL}) ||
+                  matches({OpCode::PUSH_LOCAL, OpCode::PUSH_CONST, OpCode::SUB,
+                           OpCode::POP_LOCAL})) &&
+                 mCode[i + 3].arg == first.arg)
+        {
+            // Loop counters are usually followed by the jump back to the loop head.
+            auto op = mCode[i + 2].op == OpCode::ADD ? OpCode::INC_LOCAL : OpCode::DEC_LOCAL;
+            if (continues(i + 4, OpCode::GOTO))
+                fused = {op, 5, first.arg, mCode[i + 1].arg, mCode[i + 4].target};
+            else
+                fused = {op, 4, first.arg, mCode[i + 1].arg, static_cast<int32_t>(i + 4)};
+        }
+        else if (matches({OpCode::PUSH_LOCAL, OpCode::ADD, OpCode::POP_FIXED,
+                          OpCode::PUSH_THAT}) &&
+                 mCode[i + 2].arg == THAT_POINTER && mCode[i + 3].arg == 0)
+            fused = {OpCode::READ_THAT_LOCAL, 4, first.arg, 0, 0};
+        else if (matches({OpCode::POP_FIXED, OpCode::POP_FIXED, OpCode::PUSH_FIXED,
+                          OpCode::POP_THAT}) &&
+                 first.arg >= TEMP_BASE && mCode[i + 1].arg == THAT_POINTER &&
+                 mCode[i + 2].arg == first.arg && mCode[i + 3].arg == 0)
+            fused = {OpCode::STORE_THAT, 4, first.arg, 0, 0};
+        else if (matches({OpCode::ADD, OpCode::POP_FIXED, OpCode::PUSH_THAT}) &&
+                 mCode[i + 1].arg == THAT_POINTER && mCode[i + 2].arg == 0)
+            fused = {OpCode::READ_THAT, 3, 0, 0, 0};
+        else if (matches({OpCode::PUSH_CONST}) && (length = comparison(i + 1, condition)))
+        {
+            if (continues(i + 1 + length, OpCode::IF_GOTO))
+                fused = {OpCode::CMP_CONST_IF, static_cast<uint8_t>(length + 2), first.arg, 0,
+                         mCode[i + 1 + length].target, condition};
+            else
+                fused = {OpCode::CMP_CONST, static_cast<uint8_t>(length + 1), first.arg, 0, 0,
+                         condition};
+        }
+        else if ((length = comparison(i, condition)) && continues(i + length, OpCode::IF_GOTO))
+            fused = {OpCode::CMP_IF, static_cast<uint8_t>(length + 1), 0, 0,
+                     mCode[i + length].target, condition};
+        else if (matches({OpCode::NOT, OpCode::IF_GOTO}))
+            fused = {OpCode::NOT_IF, 2, 0, 0, mCode[i + 1].target};
+        else if (matches({OpCode::POP_LOCAL, OpCode::GOTO}))
+            fused = {OpCode::POP_LOCAL_GOTO, 2, first.arg, 0, mCode[i + 1].target};
+        // Constant operands and constant folding, push constant 0; not is true.
+        else if (matches({OpCode::PUSH_CONST, OpCode::ADD}))
+            fused = {OpCode::ADD_CONST, 2, first.arg, 0, 0};
+        else if (matches({OpCode::PUSH_CONST, OpCode::SUB}))
+            fused = {OpCode::SUB_CONST, 2, first.arg, 0, 0};
+        else if (matches({OpCode::PUSH_CONST, OpCode::NEG}))
+            fused = {OpCode::PUSH_CONST, 2, -first.arg, 0, 0};
+        else if (matches({OpCode::PUSH_CONST, OpCode::NOT}))
+            fused = {OpCode::PUSH_CONST, 2, ~first.arg, 0, 0};
+        else if (matches({OpCode::PUSH_LOCAL, OpCode::ADD}))
+            fused = {OpCode::ADD_LOCAL, 2, first.arg, 0, 0};
+        else if (matches({OpCode::PUSH_ARG, OpCode::ADD}))
+            fused = {OpCode::ADD_ARG, 2, first.arg, 0, 0};
+
+        mFused[i] = fused;
+        i += fused.length;
+    }
+}
+
+auto VMInterpreter::reset() -> void
+{
+    std::fill(mRam.begin(), mRam.end(), 0);
+    mSteps = 0;
+    mDispatches = 0;
+    mHalted = mCode.empty();
+    mPc = 0;
+
+    auto init = mFunctions.find("Sys.init");
+    if (init != mFunctions.end())
+    {
+        // Same state as after the bootstrap code of the VM translator.
+        mRam[STACK_BASE] = static_cast<int16_t>(RETURN_TO_HALT);
+        mRam[0] = STACK_BASE + 5;
+        mRam[1] = STACK_BASE + 5;
+        mRam[2] = STACK_BASE;
+        mPc = init->second;
+    }
+}
+
+auto VMInterpreter::programHash() -> uint64_t
+{
+    // The plain bytecode, snapshots work with and without fusion.
+    uint64_t hash = hashValue(HASH_SEED, static_cast<int64_t>(mCode.size()));
+    for (auto &instruction : mCode)
+    {
+        hash = hashValue(hash, static_cast<int64_t>(instruction.op));
+        hash = hashValue(hash, instruction.arg);
+        hash = hashValue(hash, instruction.target);
+    }
+    return hash;
+}
+
+auto VMInterpreter::saveSnapshot(std::string const &path) -> void
+{
+    SnapshotHeader header{};
+    header.program = this->programHash();
+    header.cycles = mSteps;
+    header.pc = mPc;
+    header.halted = mHalted;
+    writeSnapshot(path, header, mRam);
+}
+
+auto VMInterpreter::restoreSnapshot(std::string const &path) -> void
+{
+    auto header = readSnapshot(path, this->programHash(), mRam);
+    if (header.pc < 0 || header.pc > static_cast<int>(mCode.size()))
+        throw std::runtime_error(path + ": program counter out of range");
+    mSteps = header.cycles;
+    mPc = header.pc;
+    mHalted = header.halted != 0;
+}
+
+auto VMInterpreter::run(uint64_t maxSteps) -> uint64_t
+{
+    if (mProfiler)
+        return this->runProfiled(maxSteps);
+    return this->interpret(maxSteps);
+}
+
+auto VMInterpreter::runProfiled(uint64_t maxSteps) -> uint64_t
+{
+    // One command at a time, so calls and returns are seen as they happen.
+    uint64_t executed = 0;
+    while (executed < maxSteps && !mHalted && mPc < static_cast<int>(mCode.size()))
+    {
+        auto pc = mPc;
+        auto op = mCode[pc].op;
+        if (this->interpret(1) == 0)
+            break;
+        executed++;
+        mProfiler->count(pc);
+        // Native calls only enter their function when falling back to its VM code.
+        if (op == OpCode::CALL || (op == OpCode::NATIVE && mPc != pc + 1))
+            mProfiler->call(mPc);
+        else if (op == OpCode::RETURN)
+            mProfiler->ret();
+    }
+    return executed;
+}
+
+auto VMInterpreter::interpret(uint64_t maxSteps) -> uint64_t
+{
+    if (mHalted)
+        return 0;
+
+    int16_t *ram = mRam.data();
+    const VMInstruction *code = mCode.data();
+    const VMInstruction *fused = mFused.data();
+    const int codeSize = static_cast<int>(mCode.size());
+    const NativeFunction *natives = nativeFunctions().data();
+    int pc = mPc;
+    uint64_t step = 0;
+    uint64_t dispatches = 0;
+
+    // Addresses wrap like on the Hack platform.
+    auto at = [ram](int address) -> int16_t & { return ram[address & (RAM_SIZE - 1)]; };
+    auto push = [&](int16_t value) {
+        at(ram[0]) = value;
+        ram[0]++;
+    };
+    auto pop = [&]() -> int16_t {
+        ram[0]--;
+        return at(ram[0]);
+    };
+    auto holds = [](uint8_t condition, int16_t x, int16_t y) -> bool {
+        return condition & (x < y ? 4 : (x == y ? 2 : 1));
+    };
+    // Fused comparison and if-goto with x at SP, the result is left where
+    // if-goto popped it.
+    auto branchIf = [&](VMInstruction const &instruction, int16_t x, int16_t y) {
+        bool result = holds(instruction.condition, x, y);
+        at(ram[0]) = result ? -1 : 0;
+        if (result)
+            pc = instruction.target;
+    };
+
+    while (step < maxSteps && !mHalted)
+    {
+        if (pc >= codeSize)
+        {
+            mHalted = true;
+            break;
+        }
+        // A superinstruction only runs if all of its commands fit into the budget.
+        auto const &instruction =
+            fused[pc].length <= maxSteps - step ? fused[pc] : code[pc];
+        step += instruction.length;
+        pc += instruction.length;
+        dispatches++;
+        switch (instruction.op)
+        {
+        case OpCode::PUSH_CONST:
+            push(static_cast<int16_t>(instruction.arg));
+            break;
+        case OpCode::PUSH_LOCAL:
+            push(at(ram[1] + instruction.arg));
+            break;
+        case OpCode::PUSH_ARG:
+            push(at(ram[2] + instruction.arg));
+            break;
+        case OpCode::PUSH_THIS:
+            push(at(ram[3] + instruction.arg));
+            break;
+        case OpCode::PUSH_THAT:
+            push(at(ram[4] + instruction.arg));
+            break;
+        case OpCode::PUSH_FIXED:
+            push(ram[instruction.arg]);
+            break;
+        case OpCode::POP_LOCAL:
+        {
+            auto value = pop();
+            at(ram[1] + instruction.arg) = value;
+            break;
+        }
+        case OpCode::POP_ARG:
+        {
+            auto value = pop();
+            at(ram[2] + instruction.arg) = value;
+            break;
+        }
+        case OpCode::POP_THIS:
+        {
+            auto value = pop();
+            at(ram[3] + instruction.arg) = value;
+            break;
+        }
+        case OpCode::POP_THAT:
+        {
+            auto value = pop();
+            at(ram[4] + instruction.arg) = value;
+            break;
+        }
+        case OpCode::POP_FIXED:
+            ram[instruction.arg] = pop();
+            break;
+        case OpCode::ADD:
+        {
+            auto y = pop();
+            at(ram[0] - 1) += y;
+            break;
+        }
+        case OpCode::SUB:
+        {
+            auto y = pop();
+            at(ram[0] - 1) -= y;
+            break;
+        }
+        case OpCode::NEG:
+            at(ram[0] - 1) = -at(ram[0] - 1);
+            break;
+        case OpCode::EQ:
+        {
+            auto y = pop();
+            at(ram[0] - 1) = at(ram[0] - 1) == y ? -1 : 0;
+            break;
+        }
+        case OpCode::GT:
+        {
+            auto y = pop();
+            at(ram[0] - 1) = at(ram[0] - 1) > y ? -1 : 0;
+            break;
+        }
+        case OpCode::LT:
+        {
+            auto y = pop();
+            at(ram[0] - 1) = at(ram[0] - 1) < y ? -1 : 0;
+            break;
+        }
+        case OpCode::AND:
+        {
+            auto y = pop();
+            at(ram[0] - 1) &= y;
+            break;
+        }
+        case OpCode::OR:
+        {
+            auto y = pop();
+            at(ram[0] - 1) |= y;
+            break;
+        }
+        case OpCode::NOT:
+            at(ram[0] - 1) = ~at(ram[0] - 1);
+            break;
+        case OpCode::GOTO:
+            pc = instruction.target;
+            break;
+        case OpCode::IF_GOTO:
+            if (pop() != 0)
+                pc = instruction.target;
+            break;
+        case OpCode::FUNCTION:
+            for (int i = 0; i < instruction.arg; i++)
+                push(0);
+            break;
+        case OpCode::NATIVE:
+        {
+            int16_t args[MAX_NATIVE_ARGS];
+            auto base = static_cast<int16_t>(ram[0] - instruction.arg);
+            for (int i = 0; i < instruction.arg; i++)
+                args[i] = at(base + i);
+            int16_t result = 0;
+            if (natives[instruction.arg2].call(args, ram, result))
+            {
+                at(base) = result;
+                ram[0] = static_cast<int16_t>(base + 1);
+                break;
+            }
+            if (instruction.target < 0)
+            {
+                // No VM code to fall back to, the program stops at the call.
+                pc -= instruction.length;
+                step -= instruction.length;
+                dispatches--;
+                mHalted = true;
+                break;
+            }
+        }
+            [[fallthrough]];
+        case OpCode::CALL:
+        {
+            push(static_cast<int16_t>(pc));
+            push(ram[1]);
+            push(ram[2]);
+            push(ram[3]);
+            push(ram[4]);
+            ram[2] = static_cast<int16_t>(ram[0] - instruction.arg - 5);
+            ram[1] = ram[0];
+            pc = instruction.target;
+            break;
+        }
+        case OpCode::RETURN:
+        {
+            int16_t frame = ram[1];
+            auto returnAddress = static_cast<uint16_t>(at(frame - 5));
+            at(ram[2]) = pop();
+            ram[0] = static_cast<int16_t>(ram[2] + 1);
+            ram[4] = at(frame - 1);
+            ram[3] = at(frame - 2);
+            ram[2] = at(frame - 3);
+            ram[1] = at(frame - 4);
+            pc = returnAddress == RETURN_TO_HALT ? codeSize : returnAddress;
+            break;
+        }
+        // Superinstructions write the same RAM words, popped ones included,
+        // in the same order as their single commands.
+        case OpCode::ADD_CONST:
+            at(ram[0]) = static_cast<int16_t>(instruction.arg);
+            at(ram[0] - 1) += static_cast<int16_t>(instruction.arg);
+            break;
+        case OpCode::SUB_CONST:
+            at(ram[0]) = static_cast<int16_t>(instruction.arg);
+            at(ram[0] - 1) -= static_cast<int16_t>(instruction.arg);
+            break;
+        case OpCode::ADD_LOCAL:
+        {
+            auto value = at(ram[1] + instruction.arg);
+            at(ram[0]) = value;
+            at(ram[0] - 1) += value;
+            break;
+        }
+        case OpCode::ADD_ARG:
+        {
+            auto value = at(ram[2] + instruction.arg);
+            at(ram[0]) = value;
+            at(ram[0] - 1) += value;
+            break;
+        }
+        case OpCode::INC_LOCAL:
+        case OpCode::DEC_LOCAL:
+        {
+            int16_t sp = ram[0];
+            at(sp) = at(ram[1] + instruction.arg);
+            at(sp + 1) = static_cast<int16_t>(instruction.arg2);
+            if (instruction.op == OpCode::INC_LOCAL)
+                at(sp) += at(sp + 1);
+            else
+                at(sp) -= at(sp + 1);
+            at(ram[1] + instruction.arg) = at(sp);
+            pc = instruction.target;
+            break;
+        }
+        case OpCode::READ_THAT:
+        {
+            int16_t sp = --ram[0];
+            at(sp - 1) += at(sp);
+            ram[4] = at(sp - 1);
+            at(sp - 1) = at(ram[4]);
+            break;
+        }
+        case OpCode::READ_THAT_LOCAL:
+        {
+            int16_t sp = ram[0];
+            at(sp) = at(ram[1] + instruction.arg);
+            at(sp - 1) += at(sp);
+            ram[4] = at(sp - 1);
+            at(sp - 1) = at(ram[4]);
+            break;
+        }
+        case OpCode::PUSH_ELEMENT:
+        {
+            int16_t sp = ram[0]++;
+            at(sp) = static_cast<int16_t>(instruction.arg2);
+            at(sp + 1) = at(ram[1] + instruction.arg);
+            at(sp) += at(sp + 1);
+            ram[4] = at(sp);
+            at(sp) = at(ram[4]);
+            break;
+        }
+        case OpCode::STORE_THAT:
+        {
+            int16_t sp = ram[0] -= 2;
+            ram[instruction.arg] = at(sp + 1);
+            ram[4] = at(sp);
+            at(sp) = ram[instruction.arg];
+            at(ram[4]) = at(sp);
+            break;
+        }
+        case OpCode::CMP_CONST:
+        {
+            int16_t sp = ram[0];
+            at(sp) = static_cast<int16_t>(instruction.arg);
+            at(sp - 1) = holds(instruction.condition, at(sp - 1), at(sp)) ? -1 : 0;
+            break;
+        }
+        case OpCode::CMP_IF:
+            ram[0] -= 2;
+            branchIf(instruction, at(ram[0]), at(ram[0] + 1));
+            break;
+        case OpCode::CMP_CONST_IF:
+            at(ram[0]) = static_cast<int16_t>(instruction.arg);
+            ram[0] -= 1;
+            branchIf(instruction, at(ram[0]), at(ram[0] + 1));
+            break;
+        case OpCode::CMP_LOCAL_IF:
+            at(ram[0]) = at(ram[1] + instruction.arg);
+            at(ram[0] + 1) = static_cast<int16_t>(instruction.arg2);
+            branchIf(instruction, at(ram[0]), at(ram[0] + 1));
+            break;
+        case OpCode::NOT_IF:
+        {
+            int16_t sp = --ram[0];
+            at(sp) = ~at(sp);
+            if (at(sp) != 0)
+                pc = instruction.target;
+            break;
+        }
+        case OpCode::POP_LOCAL_GOTO:
+        {
+            auto value = pop();
+            at(ram[1] + instruction.arg) = value;
+            pc = instruction.target;
+            break;
+        }
+        }
+    }
+
+    if (pc >= codeSize)
+        mHalted = true;
+    mPc = pc;
+    mSteps += step;
+    mDispatches += dispatches;
+    return step;
+}
+
+auto VMInterpreter::currentFunction() -> std::string
+{
+    if (mPc >= static_cast<int>(mFunctionOf.size()) || mFunctionOf[mPc] < 0)
+        return "";
+    return mFunctionNames[mFunctionOf[mPc]];
+}
+
+auto VMInterpreter::dumpRam(std::vector<int> const &addresses, std::ostream &out) -> void
+{
+    writeRamDump(mRam, addresses, out);
+}
@@ -0,0 +1,554 @@
+#include "VMOptimizer.h"
+#include "definitions.h"
+#include <algorithm>
+#include <vector>
+
+// Control can continue behind the command.
+inline auto runs_on(VMCommand const &command) -> bool
+{
+    return command.type != CommandType::RETURN && command.type != CommandType::GOTO;
+}
+
+auto VMOptimizer::callGraph() -> std::map<std::string, std::set<std::string>>
+{
+    std::map<std::string, std::set<std::string>> graph;
+    // The files are translated in order, so the last function of a file can run
+    // into the first one of the next.
+    std::string function = "";
+    VMCommand const *previous = nullptr;
+    for (auto &file : mProgram.files())
+    {
+        for (auto &command : file.commands)
+        {
+            if (command.type == CommandType::FUNCTION)
+            {
+                // Without a final return or goto the code before runs into the function.
+                if (previous != nullptr && runs_on(*previous))
+                    graph[function].insert(command.name);
+                function = command.name;
+                graph[function];
+            }
+            else if (command.type == CommandType::CALL)
+            {
+                graph[function].insert(command.name);
+            }
+            previous = &command;
+        }
+    }
+    return graph;
+}
+
+auto VMOptimizer::eliminateDeadFunctions() -> int
+{
+    // Without the bootstrap calling Sys.init the program starts at its first
+    // command.
+    std::string root = "";
+    if (mProgram.hasFunction("Sys.init"))
+        root = "Sys.init";
+    for (auto &file : mProgram.files())
+        for (auto &command : file.commands)
+            if (root.empty() && command.type == CommandType::FUNCTION)
+                root = command.name;
+    if (root.empty())
+        return 0;
+
+    // Mark everything reachable from the root.
+    auto graph = this->callGraph();
+    std::set<std::string> reachable{root};
+    std::vector<std::string> worklist{root};
+    // Code in front of the first function of a file is always executed.
+    reachable.insert("");
+    worklist.push_back("");
+    while (!worklist.empty())
+    {
+        auto function = worklist.back();
+        worklist.pop_back();
+        for (auto &callee : graph[function])
+            if (reachable.insert(callee).second)
+                worklist.push_back(callee);
+    }
+
+    // Sweep the commands of unreachable functions.
+    int removed = 0;
+    for (auto &file : mProgram.files())
+    {
+        std::vector<VMCommand> kept;
+        bool keep = true;
+        for (auto &command : file.commands)
+        {
+            if (command.type == CommandType::FUNCTION)
+            {
+                keep = reachable.count(command.name) > 0;
+                if (!keep)
+                    removed++;
+            }
+            if (keep)
+                kept.push_back(command);
+        }
+        file.commands = std::move(kept);
+    }
+    return removed;
+}
+
+// Commands [begin, end) of a file, its labels first.
+struct Block
+{
+    size_t begin;
+    size_t end;
+};
+
+inline auto is_comparison(VMCommand const &command) -> bool
+{
+    return command.type == CommandType::ARITHMETIC &&
+           (command.command == Command::EQ || command.command == Command::GT ||
+            command.command == Command::LT);
+}
+
+auto VMOptimizer::layoutFunction(std::vector<VMCommand> const &commands, size_t begin,
+                                 size_t end, ClassCounts const &counts,
+                                 std::vector<VMCommand> &out) -> bool
+{
+    auto countOf = [&](size_t index) {
+        auto found = counts.commands.find(static_cast<int>(index));
+        return found == counts.commands.end() ? CommandCount{0, 0} : found->second;
+    };
+    auto endsBlock = [](CommandType type) {
+        return type == CommandType::GOTO || type == CommandType::IF ||
+               type == CommandType::RETURN;
+    };
+
+    // Blocks start at labels and behind jumps.
+    std::vector<Block> blocks;
+    std::map<std::string, int> blockOf;
+    for (size_t i = begin + 1; i < end; i++)
+    {
+        auto type = commands[i].type;
+        if (i == begin + 1 || endsBlock(commands[i - 1].type) ||
+            (type == CommandType::LABEL && commands[i - 1].type != CommandType::LABEL))
+            blocks.push_back(Block{i, i});
+        blocks.back().end = i + 1;
+        if (type == CommandType::LABEL)
+            blockOf[commands[i].name] = static_cast<int>(blocks.size()) - 1;
+    }
+    // Code running into the next function keeps its place.
+    if (blocks.empty() || (commands[end - 1].type != CommandType::GOTO &&
+                           commands[end - 1].type != CommandType::RETURN))
+        return false;
+
+    // Successors and how often control passed to them.
+    auto n = static_cast<int>(blocks.size());
+    std::vector<int> fall(n, -1);
+    std::vector<int> jump(n, -1);
+    std::vector<uint64_t> fallCount(n, 0);
+    std::vector<uint64_t> jumpCount(n, 0);
+    std::vector<bool> invertible(n, false);
+    uint64_t cost = 0; // Executed gotos and nots that the layout may change
+    for (int b = 0; b < n; b++)
+    {
+        auto last = blocks[b].end - 1;
+        auto &terminator = commands[last];
+        auto executed = countOf(last);
+        auto target = blockOf.find(terminator.name);
+        switch (terminator.type)
+        {
+        case CommandType::GOTO:
+            if (target != blockOf.end())
+                jump[b] = target->second;
+            jumpCount[b] = executed.count;
+            cost += executed.count;
+            break;
+        case CommandType::IF:
+            fall[b] = b + 1;
+            fallCount[b] = executed.count - executed.taken;
+            if (target == blockOf.end() || target->second == b + 1)
+                break;
+            jump[b] = target->second;
+            jumpCount[b] = executed.taken;
+            // Branches on booleans are inverted by a not.
+            invertible[b] = last >= blocks[b].begin + 1 &&
+                            (is_comparison(commands[last - 1]) ||
+                             (last >= blocks[b].begin + 2 &&
+                              commands[last - 1].command == Command::NOT &&
+                              commands[last - 1].type == CommandType::ARITHMETIC &&
+                              is_comparison(commands[last - 2])));
+            break;
+        case CommandType::RETURN:
+            break;
+        default:
+            fall[b] = b + 1;
+            fallCount[b] = executed.count;
+        }
+    }
+
+    // Greedily chain blocks along the most executed edges, the ones that save
+    // a goto first, then those of branches.
+    struct Edge
+    {
+        int rank;
+        uint64_t count;
+        int from;
+        int to;
+    };
+    std::vector<Edge> edges;
+    for (int b = 0; b < n; b++)
+    {
+        bool branch = commands[blocks[b].end - 1].type == CommandType::IF;
+        if (fall[b] >= 0)
+            edges.push_back({branch ? 1 : 0, fallCount[b], b, fall[b]});
+        if (jump[b] >= 0 && (!branch || invertible[b]))
+            edges.push_back({branch ? 1 : 0, jumpCount[b], b, jump[b]});
+    }
+    std::stable_sort(edges.begin(), edges.end(), [](Edge const &a, Edge const &b) {
+        return a.rank != b.rank ? a.rank < b.rank : a.count > b.count;
+    });
+    std::vector<std::vector<int>> chains(n);
+    std::vector<int> chainOf(n);
+    for (int b = 0; b < n; b++)
+    {
+        chains[b] = {b};
+        chainOf[b] = b;
+    }
+    for (auto &edge : edges)
+    {
+        auto &from = chains[chainOf[edge.from]];
+        auto &to = chains[chainOf[edge.to]];
+        // The entry block stays first.
+        if (edge.count == 0 || edge.to == 0 || chainOf[edge.from] == chainOf[edge.to] ||
+            from.back() != edge.from || to.front() != edge.to)
+            continue;
+        for (auto block : to)
+            chainOf[block] = chainOf[edge.from];
+        from.insert(from.end(), to.begin(), to.end());
+        to.clear();
+    }
+    // Chains in the order of their first block.
+    std::vector<int> order;
+    for (auto &chain : chains)
+        order.insert(order.end(), chain.begin(), chain.end());
+    std::vector<int> next(n, -1);
+    for (int k = 0; k + 1 < n; k++)
+        next[order[k]] = order[k + 1];
+
+    // What becomes of the last command of every block.
+    enum class Exit
+    {
+        KEEP,
+        DROP,   // goto to the next block
+        INVERT, // if-goto to the former fall through block
+        GOTO    // fall through block added as goto
+    };
+    std::vector<Exit> exits(n, Exit::KEEP);
+    std::vector<bool> needsLabel(n, false);
+    uint64_t laidOutCost = 0;
+    for (int b = 0; b < n; b++)
+    {
+        auto last = blocks[b].end - 1;
+        auto type = commands[last].type;
+        if (type == CommandType::GOTO)
+        {
+            if (jump[b] >= 0 && next[b] == jump[b])
+                exits[b] = Exit::DROP;
+            else
+                laidOutCost += jumpCount[b];
+        }
+        else if (fall[b] >= 0 && next[b] != fall[b])
+        {
+            exits[b] = type == CommandType::IF && next[b] == jump[b] && invertible[b]
+                           ? Exit::INVERT
+                           : Exit::GOTO;
+            needsLabel[fall[b]] = true;
+            if (exits[b] == Exit::GOTO)
+                laidOutCost += fallCount[b];
+            else if (is_comparison(commands[last - 1]))
+                laidOutCost += countOf(last).count; // Adds a not
+            else
+                cost += countOf(last).count; // Drops a not
+        }
+    }
+    if (laidOutCost >= cost)
+        return false;
+
+    // Names of the blocks that are jumped to, new labels where needed.
+    std::vector<std::string> labels(n);
+    int nextLabel = 0;
+    for (int b = 0; b < n; b++)
+    {
+        auto &first = commands[blocks[b].begin];
+        if (first.type == CommandType::LABEL)
+            labels[b] = first.name;
+        else if (needsLabel[b])
+        {
+            do
+                labels[b] = "LAYOUT_" + std::to_string(nextLabel++);
+            while (blockOf.count(labels[b]) > 0);
+        }
+    }
+
+    out.push_back(commands[begin]);
+    for (auto b : order)
+    {
+        auto &first = commands[blocks[b].begin];
+        if (needsLabel[b] && first.type != CommandType::LABEL)
+            out.push_back({CommandType::LABEL, Command::NONE, Segment::NONE, labels[b], 0,
+                           first.line, first.sourceLine});
+        auto last = blocks[b].end - 1;
+        auto terminator = commands[last];
+        auto body = last;
+        if (exits[b] == Exit::INVERT && !is_comparison(commands[last - 1]))
+            body--; // Drop the not
+        out.insert(out.end(), commands.begin() + blocks[b].begin, commands.begin() + body);
+        switch (exits[b])
+        {
+        case Exit::KEEP:
+            out.push_back(terminator);
+            break;
+        case Exit::DROP:
+            break;
+        case Exit::INVERT:
+            if (is_comparison(commands[last - 1]))
+                out.push_back({CommandType::ARITHMETIC, Command::NOT, Segment::NONE, "", 0,
+                               terminator.line, terminator.sourceLine});
+            terminator.name = labels[fall[b]];
+            out.push_back(terminator);
+            break;
+        case Exit::GOTO:
+            out.push_back(terminator);
+            out.push_back({CommandType::GOTO, Command::NONE, Segment::NONE, labels[fall[b]],
+                           0, terminator.line, terminator.sourceLine});
+            break;
+        }
+    }
+    return true;
+}
+
+auto VMOptimizer::layoutBlocks(BlockCounts const &counts) -> int
+{
+    int changed = 0;
+    for (auto &file : mProgram.files())
+    {
+        auto profile = counts.find(file.name, static_cast<int>(file.commands.size()));
+        if (profile == nullptr)
+            continue;
+        auto &commands = file.commands;
+        std::vector<VMCommand> laidOut;
+        size_t begin = 0;
+        for (size_t i = 1; i <= commands.size(); i++)
+        {
+            if (i < commands.size() && commands[i].type != CommandType::FUNCTION)
+                continue;
+            if (commands[begin].type == CommandType::FUNCTION &&
+                this->layoutFunction(commands, begin, i, *profile, laidOut))
+                changed++;
+            else
+                laidOut.insert(laidOut.end(), commands.begin() + begin, commands.begin() + i);
+            begin = i;
+        }
+        file.commands = std::move(laidOut);
+    }
+    return changed;
+}
+
+auto VMOptimizer::shareFunctionLocals(std::vector<VMCommand> &commands, size_t begin,
+                                      size_t end) -> int
+{
+    auto nLocals = commands[begin].index;
+    // One bit per local
+    if (nLocals < 2 || nLocals > 64)
+        return 0;
+    std::map<std::string, size_t> labels;
+    for (size_t i = begin + 1; i < end; i++)
+    {
+        if (commands[i].type == CommandType::LABEL)
+            labels[commands[i].name] = i;
+        if (commands[i].segment == Segment::LOCAL && commands[i].index >= nLocals)
+            return 0;
+    }
+
+    // Successors of every command by offset from begin, end - begin stands for
+    // leaving the function.
+    auto n = end - begin;
+    std::vector<std::vector<size_t>> successors(n);
+    for (size_t i = 1; i < n; i++)
+    {
+        auto &command = commands[begin + i];
+        if (command.type == CommandType::RETURN)
+            continue;
+        if (command.type == CommandType::GOTO || command.type == CommandType::IF)
+        {
+            auto target = labels.find(command.name);
+            if (target == labels.end())
+                return 0;
+            successors[i].push_back(target->second - begin);
+        }
+        if (command.type != CommandType::GOTO)
+            successors[i].push_back(i + 1);
+    }
+
+    // Locals live behind every command, until nothing changes.
+    auto bit = [](int local) { return uint64_t{1} << local; };
+    std::vector<uint64_t> liveIn(n + 1, 0);
+    std::vector<uint64_t> liveOut(n, 0);
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (size_t i = n; i-- > 1;)
+        {
+            auto &command = commands[begin + i];
+            uint64_t out = 0;
+            for (auto successor : successors[i])
+                out |= liveIn[successor];
+            uint64_t in = out;
+            if (command.segment == Segment::LOCAL && command.type == CommandType::POP)
+                in &= ~bit(command.index);
+            if (command.segment == Segment::LOCAL && command.type == CommandType::PUSH)
+                in |= bit(command.index);
+            changed = changed || in != liveIn[i] || out != liveOut[i];
+            liveIn[i] = in;
+            liveOut[i] = out;
+        }
+    }
+
+    // Locals interfere when one is written while the other is live. The
+    // zeroing on entry writes the same 0 to every slot and does not count.
+    std::vector<uint64_t> interferes(nLocals, 0);
+    uint64_t used = 0;
+    for (size_t i = 1; i < n; i++)
+    {
+        auto &command = commands[begin + i];
+        if (command.segment != Segment::LOCAL)
+            continue;
+        used |= bit(command.index);
+        if (command.type != CommandType::POP)
+            continue;
+        auto others = liveOut[i] & ~bit(command.index);
+        interferes[command.index] |= others;
+        for (int local = 0; local < nLocals; local++)
+            if (others & bit(local))
+                interferes[local] |= bit(command.index);
+    }
+
+    // First free slot for every local in order of declaration.
+    std::vector<int> slotOf(nLocals, 0);
+    int nSlots = 0;
+    for (int local = 0; local < nLocals; local++)
+    {
+        if ((used & bit(local)) == 0)
+            continue;
+        uint64_t taken = 0;
+        for (int other = 0; other < local; other++)
+            if ((used & bit(other)) && (interferes[local] & bit(other)))
+                taken |= bit(slotOf[other]);
+        int slot = 0;
+        while (taken & bit(slot))
+            slot++;
+        slotOf[local] = slot;
+        nSlots = std::max(nSlots, slot + 1);
+    }
+    if (nSlots >= nLocals)
+        return 0;
+
+    commands[begin].index = nSlots;
+    for (size_t i = begin + 1; i < end; i++)
+        if (commands[i].segment == Segment::LOCAL)
+            commands[i].index = slotOf[commands[i].index];
+    return nLocals - nSlots;
+}
+
+auto VMOptimizer::shareLocals() -> int
+{
+    int saved = 0;
+    for (auto &file : mProgram.files())
+    {
+        auto &commands = file.commands;
+        size_t begin = 0;
+        for (size_t i = 1; i <= commands.size(); i++)
+        {
+            if (i < commands.size() && commands[i].type != CommandType::FUNCTION)
+                continue;
+            if (commands[begin].type == CommandType::FUNCTION)
+                saved += this->shareFunctionLocals(commands, begin, i);
+            begin = i;
+        }
+    }
+    return saved;
+}
+
+// Body of the function of commands [begin, end) as text, labels numbered in the
+// order they appear. Bodies with statics belong to their file.
+inline auto function_body(VMFile const &file, size_t begin, size_t end) -> std::string
+{
+    std::map<std::string, int> labels;
+    bool usesStatic = false;
+    std::string body = std::to_string(file.commands[begin].index);
+    for (size_t i = begin + 1; i < end; i++)
+    {
+        auto &command = file.commands[i];
+        body += "\n" + std::to_string(static_cast<int>(command.type)) + " " +
+                std::to_string(static_cast<int>(command.command)) + " " +
+                std::to_string(static_cast<int>(command.segment)) + " " +
+                std::to_string(command.index) + " ";
+        if (command.type == CommandType::LABEL || command.type == CommandType::GOTO ||
+            command.type == CommandType::IF)
+            body += std::to_string(labels.emplace(command.name, labels.size()).first->second);
+        else
+            body += command.name;
+        usesStatic = usesStatic || command.segment == Segment::STATIC;
+    }
+    return usesStatic ? file.name + "\n" + body : body;
+}
+
+auto VMOptimizer::foldIdenticalFunctions() -> int
+{
+    int folded = 0;
+    // Callers of folded functions may become identical in turn.
+    while (true)
+    {
+        std::map<std::string, std::string> firstWithBody;
+        std::map<std::string, std::string> copyOf;
+        // The first function of a file may be run into from the previous file,
+        // the first of the program is run without the bootstrap.
+        bool enteredFromAbove = true;
+        for (auto &file : mProgram.files())
+        {
+            auto &commands = file.commands;
+            size_t begin = 0;
+            for (size_t i = 1; i <= commands.size(); i++)
+            {
+                if (i < commands.size() && commands[i].type != CommandType::FUNCTION)
+                    continue;
+                // Functions running into the next one keep their place, as do
+                // the functions they run into and the entry point.
+                auto &name = commands[begin].name;
+                bool runsOn = runs_on(commands[i - 1]);
+                if (commands[begin].type == CommandType::FUNCTION && !runsOn)
+                {
+                    auto first = firstWithBody.emplace(function_body(file, begin, i), name);
+                    if (!first.second && name != "Sys.init" && !enteredFromAbove)
+                        copyOf[name] = first.first->second;
+                }
+                enteredFromAbove = runsOn;
+                begin = i;
+            }
+        }
+        if (copyOf.empty())
+            return folded;
+
+        for (auto &file : mProgram.files())
+        {
+            std::vector<VMCommand> kept;
+            bool keep = true;
+            for (auto &command : file.commands)
+            {
+                if (command.type == CommandType::FUNCTION)
+                    keep = copyOf.count(command.name) == 0;
+                if (!keep)
+                    continue;
+                kept.push_back(command);
+                if (command.type == CommandType::CALL && copyOf.count(command.name))
+                    kept.back().name = copyOf[command.name];
+            }
+            file.commands = std::move(kept);
+        }
+        folded += static_cast<int>(copyOf.size());
+    }
+}
@@ -0,0 +1,123 @@
+#include "VMParser.h"
+#include "SourceMap.h"
+#include "VMBytecode.h"
+#include "definitions.h"
+#include <filesystem>
+#include <sstream>
+#include <stdexcept>
+
+auto VMParser::parse() -> VMFile
+{
+    if (!mFile.is_open())
+        throw std::runtime_error("Cannot open file: " + mPath);
+
+    VMFile file;
+    file.path = mPath;
+    file.name = std::filesystem::path(mPath).stem().string();
+    auto mapPath = mPath + ".map";
+    if (mPath.ends_with(".vmb"))
+    {
+        file = readBytecode(mPath);
+        // Bytecode converted from text shares the source map of the .vm file.
+        if (!std::filesystem::exists(mapPath))
+            mapPath = mPath.substr(0, mPath.size() - 1) + ".map";
+    }
+
+    std::string line;
+    while (!mPath.ends_with(".vmb") && getline(mFile, line))
+    {
+        mLineNumber++;
+
+        // Remove comment section and the \r token.
+        if (line.find("//") != std::string::npos)
+            line = line.substr(0, line.find("//"));
+        while (line.find("\r") != std::string::npos)
+            line.erase(line.find("\r"), 1);
+
+        // Skip empty lines and pure comments
+        if (line.find_first_not_of(" \t") == std::string::npos)
+            continue;
+
+        file.commands.push_back(this->parseLine(line));
+    }
+
+    // The compiler's source map has an entry per command.
+    if (std::filesystem::exists(mapPath))
+    {
+        SourceMap sourceMap;
+        sourceMap.read(mapPath);
+        if (!sourceMap.files().empty())
+            file.source = sourceMap.files().front();
+        for (size_t i = 0; i < file.commands.size(); i++)
+            file.commands[i].sourceLine = sourceMap.at(i).line;
+    }
+    return file;
+}
+
+auto VMParser::parseLine(std::string const &line) -> VMCommand
+{
+    std::istringstream stream(line);
+    std::string keyword;
+    std::string arg1;
+    int arg2 = 0;
+    stream >> keyword >> arg1 >> arg2;
+
+    VMCommand command{.type = CommandType::ARITHMETIC,
+                      .command = Command::NONE,
+                      .segment = Segment::NONE,
+                      .name = "",
+                      .index = 0,
+                      .line = mLineNumber,
+                      .sourceLine = 0};
+
+    if (stringToCommand.count(keyword))
+    {
+        command.command = stringToCommand[keyword];
+    }
+    else if (keyword == "push" || keyword == "pop")
+    {
+        if (!stringToSegment.count(arg1))
+            throw std::runtime_error(mPath + ":" + std::to_string(mLineNumber) +
+                                     ": invalid segment " + arg1);
+        command.type = keyword == "push" ? CommandType::PUSH : CommandType::POP;
+        command.segment = stringToSegment[arg1];
+        command.index = arg2;
+    }
+    else if (keyword == "label")
+    {
+        command.type = CommandType::LABEL;
+        command.name = arg1;
+    }
+    else if (keyword == "goto")
+    {
+        command.type = CommandType::GOTO;
+        command.name = arg1;
+    }
+    else if (keyword == "if-goto")
+    {
+        command.type = CommandType::IF;
+        command.name = arg1;
+    }
+    else if (keyword == "function")
+    {
+        command.type = CommandType::FUNCTION;
+        command.name = arg1;
+        command.index = arg2;
+    }
+    else if (keyword == "call")
+    {
+        command.type = CommandType::CALL;
+        command.name = arg1;
+        command.index = arg2;
+    }
+    else if (keyword == "return")
+    {
+        command.type = CommandType::RETURN;
+    }
+    else
+    {
+        throw std::runtime_error(mPath + ":" + std::to_string(mLineNumber) +
+                                 ": invalid command " + keyword);
+    }
+    return command;
+}
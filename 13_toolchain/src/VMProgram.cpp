@@ -0,0 +1,150 @@
+#include "VMProgram.h"
+#include "VMBytecode.h"
+#include "VMParser.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+inline auto to_text(VMCommand const &command) -> std::string
+{
+    switch (command.type)
+    {
+    case CommandType::ARITHMETIC:
+        return commandToString[command.command];
+    case CommandType::PUSH:
+    case CommandType::POP:
+        return std::string{command.type == CommandType::PUSH ? "push " : "pop "} +
+               segmentToString[command.segment] + " " + std::to_string(command.index);
+    case CommandType::LABEL:
+        return "label " + command.name;
+    case CommandType::GOTO:
+        return "goto " + command.name;
+    case CommandType::IF:
+        return "if-goto " + command.name;
+    case CommandType::FUNCTION:
+        return "function " + command.name + " " + std::to_string(command.index);
+    case CommandType::CALL:
+        return "call " + command.name + " " + std::to_string(command.index);
+    case CommandType::RETURN:
+        return "return";
+    }
+    return "";
+}
+
+auto VMProgram::load(std::string const &pathOrDir) -> void
+{
+    std::vector<std::string> paths;
+    if (std::filesystem::is_directory(pathOrDir))
+    {
+        for (const auto &dirEntry : std::filesystem::directory_iterator(pathOrDir))
+        {
+            std::string path = dirEntry.path();
+            if (path.ends_with(".vm"))
+            {
+                // Prefer bytecode of the same class unless the text is newer.
+                auto bytecode = path + "b";
+                std::error_code error;
+                if (std::filesystem::exists(bytecode) &&
+                    std::filesystem::last_write_time(bytecode, error) >=
+                        std::filesystem::last_write_time(path, error))
+                    continue;
+                paths.push_back(path);
+            }
+            else if (path.ends_with(".vmb"))
+            {
+                auto text = path.substr(0, path.size() - 1);
+                std::error_code error;
+                if (std::filesystem::exists(text) &&
+                    std::filesystem::last_write_time(path, error) <
+                        std::filesystem::last_write_time(text, error))
+                    continue;
+                paths.push_back(path);
+            }
+        }
+        // Directory order is unspecified, sort to get reproducible output.
+        std::sort(paths.begin(), paths.end());
+    }
+    else if (pathOrDir.ends_with(".vm") || pathOrDir.ends_with(".vmb"))
+    {
+        paths.push_back(pathOrDir);
+    }
+    else
+    {
+        throw std::invalid_argument("Not a .vm or .vmb file or directory: " + pathOrDir);
+    }
+
+    for (auto &path : paths)
+        this->addFile(VMParser(path).parse());
+}
+
+auto VMProgram::loadLibrary(std::string const &dir) -> int
+{
+    if (!std::filesystem::is_directory(dir))
+        throw std::invalid_argument("Not a directory: " + dir);
+    auto library = VMProgram();
+    library.load(dir);
+
+    int added = 0;
+    for (auto &file : library.files())
+    {
+        bool defined = std::any_of(mFiles.begin(), mFiles.end(),
+                                   [&](VMFile const &own) { return own.name == file.name; });
+        if (defined)
+            continue;
+        this->addFile(std::move(file));
+        added++;
+    }
+    return added;
+}
+
+auto VMProgram::addFile(VMFile file) -> void
+{
+    mFiles.push_back(std::move(file));
+}
+
+auto VMProgram::hasFunction(std::string const &name) -> bool
+{
+    for (auto &file : mFiles)
+        for (auto &command : file.commands)
+            if (command.type == CommandType::FUNCTION && command.name == name)
+                return true;
+    return false;
+}
+
+auto VMProgram::commandCount() -> int
+{
+    int count = 0;
+    for (auto &file : mFiles)
+        count += file.commands.size();
+    return count;
+}
+
+auto VMProgram::save(std::string const &dir, bool bytecode) -> void
+{
+    std::filesystem::create_directories(dir);
+    for (auto &file : mFiles)
+    {
+        // Files whose functions were all removed are not written at all.
+        if (file.commands.empty())
+            continue;
+        if (bytecode)
+        {
+            writeBytecode(file, std::filesystem::path(dir) / (file.name + ".vmb"));
+            continue;
+        }
+        std::ofstream out(std::filesystem::path(dir) / (file.name + ".vm"));
+        for (auto &command : file.commands)
+            out << to_text(command) << "\n";
+    }
+}
+
+auto VMProgram::functionCount() -> int
+{
+    int count = 0;
+    for (auto &file : mFiles)
+        for (auto &command : file.commands)
+            if (command.type == CommandType::FUNCTION)
+                count++;
+    return count;
+}
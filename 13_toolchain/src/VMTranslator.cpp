@@ -0,0 +1,220 @@
+#include "CodeWriter.h"
+#include "VMOptimizer.h"
+#include "VMProgram.h"
+#include "definitions.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+inline auto build_output_path(std::string const &inPath) -> std::string
+{
+    auto path = std::filesystem::path(inPath);
+    if (path.extension() == ".vm" || path.extension() == ".vmb")
+        return path.replace_extension(".asm").string();
+    // Directory: dir/dir.asm
+    if (path.filename().empty())
+        path = path.parent_path();
+    return (path / path.filename()).string() + ".asm";
+}
+
+inline auto read_file(std::string const &path) -> std::string
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::string{std::istreambuf_iterator<char>(file),
+                       std::istreambuf_iterator<char>()};
+}
+
+// Replace path by the freshly written tmpPath unless both are the same, so
+// unchanged files keep their time stamp and HackLinker its cached object.
+inline auto replace_if_changed(std::string const &tmpPath, std::string const &path) -> bool
+{
+    if (std::filesystem::exists(path) && read_file(path) == read_file(tmpPath))
+    {
+        std::filesystem::remove(tmpPath);
+        return false;
+    }
+    std::filesystem::rename(tmpPath, path);
+    return true;
+}
+
+// One .asm file per .vm file and Bootstrap.asm with the bootstrap code and the
+// shared routines, for HackLinker.
+inline auto translate_split(VMProgram &program, std::string const &dir, bool sizeOptimized,
+                            bool tailCalls, bool intrinsics) -> void
+{
+    std::filesystem::create_directories(dir);
+    std::map<std::string, int> sharedRoutineUses;
+    int instructions = 0;
+    int changed = 0;
+    for (auto &file : program.files())
+    {
+        auto path = (std::filesystem::path(dir) / (file.name + ".asm")).string();
+        auto writer = CodeWriter(path + ".tmp");
+        writer.setSizeOptimized(sizeOptimized);
+        writer.setTailCalls(tailCalls);
+        writer.setIntrinsics(intrinsics);
+        writer.setFileName(file.name);
+        writer.translate(file.commands);
+        writer.close();
+        for (auto &[routine, uses] : writer.sharedRoutineUses())
+            sharedRoutineUses[routine] += uses;
+        instructions += writer.instructionCount();
+        changed += replace_if_changed(path + ".tmp", path);
+    }
+
+    auto path = (std::filesystem::path(dir) / "Bootstrap.asm").string();
+    auto writer = CodeWriter(path + ".tmp");
+    writer.setSizeOptimized(sizeOptimized);
+    writer.addSharedRoutineUses(sharedRoutineUses);
+    // HackLinker places the bootstrap first, programs without Sys.init start
+    // with the first file behind it.
+    bool hasInit = program.hasFunction("Sys.init");
+    if (hasInit)
+        writer.writeInit();
+    else if (!sharedRoutineUses.empty())
+        writer.writeGoto("BOOTSTRAP_END");
+    writer.writeSharedRoutines();
+    if (!hasInit && !sharedRoutineUses.empty())
+        writer.writeLabel("BOOTSTRAP_END");
+    writer.close();
+    instructions += writer.instructionCount();
+    changed += replace_if_changed(path + ".tmp", path);
+
+    std::cout << dir << ": " << program.files().size() + 1 << " files, " << changed
+              << " changed, " << instructions << " instructions" << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        throw std::invalid_argument(
+            "Usage: 'VMTranslator <file.vm|file.vmb|dir> [-o out.asm] [--size] "
+            "[--tail-calls] [--intrinsics] [--gc-functions] [--fold-functions] "
+            "[--share-locals] [--layout counts.txt] [--emit-vm dir] [--emit-vmb dir] "
+            "[--split dir]'");
+    }
+
+    std::string pathOrDir = std::string(argv[1]);
+    std::string outputPath = build_output_path(pathOrDir);
+    std::string vmOutputDir = "";
+    std::string splitDir = "";
+    std::string countsPath = "";
+    bool bytecode = false;
+    bool sizeOptimized = false;
+    bool tailCalls = false;
+    bool intrinsics = false;
+    bool gcFunctions = false;
+    bool foldFunctions = false;
+    bool shareLocals = false;
+    for (int i = 2; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "-o" && i + 1 < argc)
+            outputPath = argv[++i];
+        else if (arg == "--size")
+            sizeOptimized = true;
+        else if (arg == "--tail-calls")
+            tailCalls = true;
+        else if (arg == "--intrinsics")
+            intrinsics = true;
+        else if (arg == "--gc-functions")
+            gcFunctions = true;
+        else if (arg == "--fold-functions")
+            foldFunctions = true;
+        else if (arg == "--share-locals")
+            shareLocals = true;
+        else if (arg == "--layout" && i + 1 < argc)
+            countsPath = argv[++i];
+        else if ((arg == "--emit-vm" || arg == "--emit-vmb") && i + 1 < argc)
+        {
+            bytecode = arg == "--emit-vmb";
+            vmOutputDir = argv[++i];
+        }
+        else if (arg == "--split" && i + 1 < argc)
+            splitDir = argv[++i];
+        else
+            throw std::invalid_argument("Unknown option: " + arg);
+    }
+
+    auto program = VMProgram();
+    program.load(pathOrDir);
+
+    // Whole program passes, the layout first: the profile matches the classes
+    // only as long as no other pass removed commands.
+    auto optimizer = VMOptimizer(program);
+    if (!countsPath.empty())
+    {
+        auto counts = BlockCounts();
+        counts.read(countsPath);
+        for (auto &file : program.files())
+            if (counts.contains(file.name) &&
+                counts.find(file.name, static_cast<int>(file.commands.size())) == nullptr)
+                std::cerr << "Warning: " << file.name << " changed since " << countsPath
+                          << " was recorded, not laid out" << std::endl;
+        auto changed = optimizer.layoutBlocks(counts);
+        std::cout << "Laid out " << changed << " functions by " << countsPath << std::endl;
+    }
+    if (gcFunctions)
+    {
+        auto nFunctions = program.functionCount();
+        auto removed = optimizer.eliminateDeadFunctions();
+        std::cout << "Removed " << removed << " of " << nFunctions
+                  << " functions as unreachable" << std::endl;
+    }
+    if (foldFunctions)
+    {
+        auto folded = optimizer.foldIdenticalFunctions();
+        std::cout << "Folded " << folded << " functions into identical ones" << std::endl;
+    }
+    if (shareLocals)
+    {
+        auto saved = optimizer.shareLocals();
+        std::cout << "Saved " << saved << " local slots" << std::endl;
+    }
+
+    // Stop after the VM passes, e.g. to feed the result to other VM tools.
+    if (!vmOutputDir.empty())
+    {
+        program.save(vmOutputDir, bytecode);
+        std::cout << vmOutputDir << ": " << program.commandCount() << " VM commands"
+                  << std::endl;
+        return 0;
+    }
+
+    if (!splitDir.empty())
+    {
+        translate_split(program, splitDir, sizeOptimized, tailCalls, intrinsics);
+        return 0;
+    }
+
+    auto writer = CodeWriter(outputPath);
+    writer.setSizeOptimized(sizeOptimized);
+    writer.setTailCalls(tailCalls);
+    writer.setIntrinsics(intrinsics);
+
+    // Bootstrap only for complete programs, test scripts set up SP themselves.
+    if (program.hasFunction("Sys.init"))
+        writer.writeInit();
+
+    for (auto &file : program.files())
+    {
+        writer.setFileName(file.name);
+        writer.translate(file.commands);
+    }
+    writer.writeSharedRoutines();
+    writer.close();
+
+    std::cout << outputPath << ": " << program.commandCount() << " VM commands, "
+              << writer.instructionCount() << " instructions" << std::endl;
+    for (auto &[routine, uses] : writer.sharedRoutineUses())
+        std::cout << "  " << routine << ": " << uses << " uses" << std::endl;
+    if (writer.instructionCount() > ROM_SIZE)
+        std::cerr << "Warning: program does not fit into the " << ROM_SIZE
+                  << " words of ROM" << std::endl;
+    return 0;
+}
@@ -0,0 +1,13 @@
+// Runs FallThrough.asm, translated from the VM files by tests/RunOptimized.cmake
+// with the pass under test.
+
+load FallThrough.asm,
+output-file FallThrough.out,
+compare-to FallThrough.cmp,
+output-list RAM[5]%D1.6.1 RAM[6]%D1.6.1 RAM[7]%D1.6.1 RAM[8]%D1.6.1;
+
+repeat 1000 {
+  ticktock;
+}
+
+output;
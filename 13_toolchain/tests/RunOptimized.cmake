@@ -0,0 +1,21 @@
+# Translates the VM program in SOURCE with the VMTranslator options in FLAGS
+# (a ;-list) to WORK and runs its .tst scripts on the result.
+#
+# cmake -DVMTRANSLATOR=.. -DTESTRUNNER=.. -DSOURCE=dir -DFLAGS=.. -DWORK=dir -P RunOptimized.cmake
+
+get_filename_component(NAME ${SOURCE} NAME)
+file(REMOVE_RECURSE ${WORK})
+file(MAKE_DIRECTORY ${WORK})
+file(GLOB SCRIPTS ${SOURCE}/*.tst ${SOURCE}/*.cmp)
+file(COPY ${SCRIPTS} DESTINATION ${WORK})
+
+execute_process(COMMAND ${VMTRANSLATOR} ${SOURCE} -o ${WORK}/${NAME}.asm ${FLAGS}
+                RESULT_VARIABLE RESULT)
+if(NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "VMTranslator failed on ${SOURCE}")
+endif()
+
+execute_process(COMMAND ${TESTRUNNER} ${WORK} --out ${WORK}/out RESULT_VARIABLE RESULT)
+if(NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "${NAME} failed with ${FLAGS}")
+endif()